@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ATStats.cpp
+ */
+
+#include <gsm/ATStats.h>
+
+#include <base/fnv1.h>
+
+namespace gsm
+{
+
+uint32_t ATStats::Key(const char* cmd, size_t len)
+{
+    FNV1a hash;
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = cmd[i];
+        if (c == '=' || c == '?' || c == ';' || c == '%')
+        {
+            break;
+        }
+        hash += c;
+    }
+    return hash;
+}
+
+const ATStats::Entry* ATStats::Find(uint32_t key) const
+{
+    for (auto& e: entries)
+    {
+        if (e.total && e.key == key)
+        {
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+unsigned ATStats::Bucket(mono_t latency)
+{
+    unsigned ms = latency / MonoFromMilliseconds(1);
+    unsigned bucket = ms ? 32 - __builtin_clz(ms) : 0;
+    return std::min(bucket, unsigned(Buckets - 1));
+}
+
+void ATStats::Record(uint32_t key, mono_t latency, mono_t firstByte)
+{
+    Entry* e = (Entry*)Find(key);
+    if (!e)
+    {
+        // replace the least used command
+        e = &entries[0];
+        for (auto& other: entries)
+        {
+            if (other.total < e->total)
+            {
+                e = &other;
+            }
+        }
+        memset(e, 0, sizeof(*e));
+        e->key = key;
+    }
+
+    e->buckets[Bucket(latency)]++;
+    e->firstByte[Bucket(firstByte)]++;
+
+    if (++e->total >= DecayAt)
+    {
+        e->total = 0;
+        for (auto& n: e->buckets)
+        {
+            e->total += (n >>= 1);
+        }
+        for (auto& n: e->firstByte)
+        {
+            n >>= 1;
+        }
+    }
+}
+
+unsigned ATStats::Percentile(uint32_t key, unsigned permille) const
+{
+    auto e = Find(key);
+    if (!e || e->total < MinSamples)
+    {
+        return 0;
+    }
+
+    unsigned need = (e->total * permille + 999) / 1000;
+    unsigned sum = 0;
+    for (unsigned i = 0; i < Buckets; i++)
+    {
+        if ((sum += e->buckets[i]) >= need)
+        {
+            return 1u << i;
+        }
+    }
+    return 1u << (Buckets - 1);
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ATStats.h
+ *
+ * Response latency statistics of AT commands
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace gsm
+{
+
+class ATStats
+{
+public:
+    enum
+    {
+        //! Number of distinct commands tracked, the least used one is replaced
+        Commands = 16,
+        //! Log-scale buckets, bucket N holds latencies below 2^N ms
+        Buckets = 16,
+        //! Minimum number of samples before the statistics are used
+        MinSamples = 8,
+        //! All counts of a command are halved when its total reaches this value,
+        //! so that the statistics follow changing conditions
+        DecayAt = 1024,
+    };
+
+    //! Calculates the key of a command, the name up to the first parameter
+    static uint32_t Key(const char* cmd, size_t len);
+    static uint32_t Key(Span cmd) { return Key((const char*)cmd.Pointer(), cmd.Length()); }
+
+    //! Latency histograms of one command, both measured from the moment the command
+    //! is handed to the transmit pipe
+    struct Entry
+    {
+        uint32_t key;
+        uint16_t total;
+        uint16_t buckets[Buckets];      //!< until the final result (OK, ERROR or the result replacing them)
+        uint16_t firstByte[Buckets];    //!< until the first line of the response or the data prompt, unsolicited lines do not count
+    };
+
+    //! Records the latencies of a command that has been answered
+    void Record(uint32_t key, mono_t latency, mono_t firstByte);
+    //! Gets the latency in ms under which the specified portion of responses arrived
+    //! @returns 0 if there are not enough samples for the command
+    unsigned Percentile(uint32_t key, unsigned permille) const;
+
+    //! Gets the histograms of the command with the specified key, NULL if it is not tracked
+    const Entry* Find(uint32_t key) const;
+    //! Gets the histograms of all tracked commands, unused entries have zero total
+    const Entry* Entries() const { return entries; }
+
+private:
+    Entry entries[Commands] = {};
+
+    static unsigned Bucket(mono_t latency);
+};
+
+}
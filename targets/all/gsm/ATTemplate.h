@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ATTemplate.h
+ *
+ * Pre-built AT commands for the hot path, avoiding the printf-style formatter
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace gsm
+{
+
+//! Constant part of an AT command, including the AT prefix, built at compile time
+template<size_t N> class ATTemplate
+{
+public:
+    constexpr ATTemplate(const char (&cmd)[N])
+    {
+        text[0] = 'A';
+        text[1] = 'T';
+        for (size_t i = 0; i < N - 1; i++)
+        {
+            text[i + 2] = cmd[i];
+        }
+    }
+
+    Span Prefix() const { return Span(text, sizeof(text)); }
+
+private:
+    char text[N + 1] = {};
+};
+
+//! Comma separated arguments following an ATTemplate
+class ATArgs
+{
+public:
+    enum
+    {
+        MaxLength = 32,
+    };
+
+    ATArgs& Int(int n)
+    {
+        char digits[11];
+        size_t i = 0;
+        unsigned u = n < 0 ? -unsigned(n) : n;
+        do
+        {
+            digits[i++] = '0' + u % 10;
+            u /= 10;
+        } while (u);
+
+        if (!Separator(i + (n < 0)))
+        {
+            return *this;
+        }
+        if (n < 0)
+        {
+            buf[len++] = '-';
+        }
+        while (i)
+        {
+            buf[len++] = digits[--i];
+        }
+        return *this;
+    }
+
+    Span Get() const { return Span(buf, len); }
+    //! Checks if all the arguments fit in the buffer
+    bool IsValid() const { return !overflow; }
+
+private:
+    char buf[MaxLength];
+    uint8_t len = 0;
+    bool overflow = false;
+
+    //! Makes room for the next argument, including the separator
+    //! @returns false if the argument does not fit, the arguments are then marked invalid
+    bool Separator(size_t next)
+    {
+        if (overflow || len + !!len + next > MaxLength)
+        {
+            overflow = true;
+            return false;
+        }
+        if (len)
+        {
+            buf[len++] = ',';
+        }
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/BootHistory.cpp
+ */
+
+#include <gsm/BootHistory.h>
+
+namespace gsm
+{
+
+void BootHistory::Start()
+{
+    Leave(false);
+    memset(&records[count++ % Records], 0, sizeof(BootRecord));
+}
+
+void BootHistory::Enter(BootPhase phase)
+{
+    ASSERT(count);
+    Leave(true);
+    running = &records[(count - 1) % Records].phases[unsigned(phase)];
+    running->start = MONO_CLOCKS;
+    running->outcome = BootRecord::Outcome::Running;
+}
+
+void BootHistory::Leave(bool ok)
+{
+    if (running)
+    {
+        running->end = MONO_CLOCKS;
+        running->outcome = ok ? BootRecord::Outcome::Ok : BootRecord::Outcome::Failed;
+        running = NULL;
+    }
+}
+
+void BootHistory::Retry()
+{
+    if (running && running->retries < 255)
+    {
+        running->retries++;
+    }
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/BootHistory.h
+ *
+ * Timing of the phases of recent modem starts
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+#ifndef GSM_BOOT_RECORDS
+#define GSM_BOOT_RECORDS    4
+#endif
+
+namespace gsm
+{
+
+//! Phases of a modem start, in the order in which they are entered
+enum struct BootPhase : uint8_t
+{
+    PowerOn,
+    RxStart,
+    Start,          //!< autobauding and initialization
+    UnlockSim,
+    Register,       //!< network registration
+    Gprs,           //!< attach, PDP context and data services
+    FirstConnect,   //!< connection of the first socket
+};
+
+struct BootRecord
+{
+    enum
+    {
+        Phases = unsigned(BootPhase::FirstConnect) + 1,
+    };
+
+    enum struct Outcome : uint8_t
+    {
+        NotReached,
+        Running,
+        Ok,
+        Failed,
+    };
+
+    struct Phase
+    {
+        mono_t start, end;  //!< end is valid only once the phase is finished
+        uint8_t retries;    //!< e.g. probes during autobauding, SIM status queries
+        Outcome outcome;
+    } phases[Phases];
+
+    const Phase& operator[](BootPhase phase) const { return phases[unsigned(phase)]; }
+    mono_t Duration(BootPhase phase) const { auto& p = (*this)[phase]; return p.outcome >= Outcome::Ok ? p.end - p.start : 0; }
+    //! Time from the start of powering on to the first connected socket,
+    //! zero if the start has not reached it successfully
+    mono_t TimeToConnect() const { auto& p = (*this)[BootPhase::FirstConnect]; return p.outcome == Outcome::Ok ? p.end - phases[0].start : 0; }
+};
+
+class BootHistory
+{
+public:
+    enum
+    {
+        Records = GSM_BOOT_RECORDS,
+    };
+
+    //! Number of records available
+    unsigned Count() const { return std::min(count, unsigned(Records)); }
+    //! Gets a record, 0 being the current or the last start
+    //! @returns NULL if there is no such record
+    const BootRecord* Get(unsigned n) const { return n < Count() ? &records[(count - 1 - n) % Records] : NULL; }
+
+    //! Starts a new record, replacing the oldest one
+    void Start();
+    //! Enters the next phase, the current one is finished successfully
+    void Enter(BootPhase phase);
+    //! Finishes the current phase, if any
+    void Leave(bool ok);
+    //! Counts a retry in the current phase
+    void Retry();
+    //! Checks if the phase of the current start has not been entered yet
+    bool Pending(BootPhase phase) const { return count && Current()[phase].outcome == BootRecord::Outcome::NotReached; }
+
+private:
+    BootRecord records[Records] = {};
+    unsigned count = 0;
+    BootRecord::Phase* running = NULL;
+
+    const BootRecord& Current() const { return records[(count - 1) % Records]; }
+};
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/Counters.h
+ *
+ * Activity counters of the modem and its sockets
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace gsm
+{
+
+//! Data transferred by a socket since it was created
+struct SocketCounters
+{
+    uint32_t sent;      //!< bytes passed to the modem
+    uint32_t acked;     //!< bytes confirmed by the modem and removed from the output
+    uint32_t received;  //!< bytes received from the modem
+};
+
+//! Phases of Modem::Task, mostly in the order in which they are entered
+enum struct TaskPhase : uint8_t
+{
+    Off,        //!< the task is not running
+    PowerOn,
+    Start,      //!< synchronization and configuration of the modem
+    UnlockSim,
+    Register,   //!< network registration
+    Active,     //!< processing sockets and messages
+    Sleep,
+    Disconnect,
+    Stop,       //!< shutdown and power off
+};
+
+//! Counters of the modem activity
+//! The counters are updated only by the driver tasks, which never preempt
+//! each other, so they are plain integers and any copy is consistent
+struct ModemCounters
+{
+    enum
+    {
+        Phases = unsigned(TaskPhase::Stop) + 1,
+        //! Distinct events counted, further ones are counted together
+        Events = 16,
+    };
+
+    // updated with every command and line, kept together
+    uint32_t commands;      //!< AT commands sent
+    uint32_t lines;         //!< lines received
+    uint32_t sent;          //!< socket data passed to the modem, total of all sockets
+    uint32_t acked;         //!< socket data confirmed by the modem
+    uint32_t received;      //!< socket data received from the modem
+
+    uint32_t errors;        //!< commands answered with an error
+    uint32_t timeouts;      //!< commands without a response
+    uint32_t failures;      //!< commands not executed because the AT sequence was broken
+    uint32_t retries;       //!< commands executed again one by one after a failed combined command
+    uint32_t resyncs;       //!< attempts to resynchronize the AT sequence
+    uint32_t reconnects;    //!< reconnection attempts of persistent sockets
+
+    mono_t atLockTime;      //!< total time for which the AT lock was held
+    mono_t phaseTime[Phases];
+
+    //! Lines handled as events (unsolicited, or responses parsed the same way),
+    //! by the hash of their header (see Modem::HashHeader) in the order of first arrival
+    struct
+    {
+        uint32_t hash, count;
+    } events[Events];
+    uint32_t otherEvents;   //!< events not fitting in the table
+
+    mono_t PhaseTime(TaskPhase phase) const { return phaseTime[unsigned(phase)]; }
+
+    //! Number of the events with the specified header hash, e.g. fnv1a("+CPSI")
+    uint32_t EventCount(uint32_t hash) const
+    {
+        for (auto& e: events)
+        {
+            if (e.count && e.hash == hash)
+            {
+                return e.count;
+            }
+        }
+        return 0;
+    }
+
+    void Event(uint32_t hash)
+    {
+        for (auto& e: events)
+        {
+            if (!e.count)
+            {
+                e.hash = hash;
+            }
+            if (e.hash == hash)
+            {
+                e.count++;
+                return;
+            }
+        }
+        otherEvents++;
+    }
+};
+
+}
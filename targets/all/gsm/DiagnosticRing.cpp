@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/DiagnosticRing.cpp
+ */
+
+#include <gsm/DiagnosticRing.h>
+
+namespace gsm
+{
+
+void DiagnosticRing::Init(Buffer storage)
+{
+    ASSERT(!size);
+    // keep all records aligned
+    auto start = (char*)Align((uintptr_t)storage.Pointer());
+    data = start;
+    size = (storage.Length() - (start - (char*)storage.Pointer())) & ~3;
+}
+
+Buffer DiagnosticRing::Reserve(ModemOptions::CallbackType type, size_t len)
+{
+    ASSERT(!pending);
+
+    size_t need = Align(sizeof(Header) + len);
+    size_t off = written % size;
+    size_t skip = 0;
+
+    if (size - off < need)
+    {
+        // records are never split, so the consumer can reference them in place
+        skip = size - off;
+    }
+
+    if (len >= Wrap || written - read + skip + need > size)
+    {
+        dropped++;
+        return Buffer();
+    }
+
+    if (skip)
+    {
+        if (skip >= sizeof(Header))
+        {
+            ((Header*)(data + off))->length = Wrap;
+        }
+        written += skip;
+        off = 0;
+    }
+
+    pending = (Header*)(data + off);
+    pending->time = MONO_CLOCKS;
+    pending->type = type;
+    return Buffer(data + off + sizeof(Header), len);
+}
+
+void DiagnosticRing::Commit(size_t len)
+{
+    ASSERT(pending);
+    pending->length = len;
+    pending = NULL;
+    written += Align(sizeof(Header) + len);
+}
+
+async(DiagnosticRing::Drain, ModemOptions& options)
+async_def(
+    uint32_t reported;
+    Header* hdr;
+)
+{
+    for (;;)
+    {
+        await_mask_not(written, ~0u, read);
+
+        {
+            size_t off = read % size;
+            f.hdr = (Header*)(data + off);
+            if (size - off < sizeof(Header) || f.hdr->length == Wrap)
+            {
+                read += size - off;
+                continue;
+            }
+        }
+
+        // the record stays in the ring until the consumer is done with it
+        await(options.DiagnosticRecord, f.hdr->type, f.hdr->time, (char*)(f.hdr + 1), f.hdr->length);
+        read += Align(sizeof(Header) + f.hdr->length);
+
+        if (f.reported != dropped)
+        {
+            options.DiagnosticsDropped(dropped - f.reported);
+            f.reported = dropped;
+        }
+
+        // the consumer is not urgent, let the modem run
+        async_yield();
+    }
+}
+async_end
+
+}
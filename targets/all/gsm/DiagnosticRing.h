@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/DiagnosticRing.h
+ *
+ * Bounded ring of diagnostic records, decoupling the consumer from modem I/O
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+#include "ModemOptions.h"
+
+namespace gsm
+{
+
+class DiagnosticRing
+{
+public:
+    bool IsEnabled() const { return size; }
+    //! Number of records dropped because the ring was full
+    uint32_t Dropped() const { return dropped; }
+
+    //! Uses the specified memory for the ring, can be done only once
+    void Init(Buffer storage);
+
+    //! Reserves space for a record of the specified length, the data must be
+    //! filled in and committed before any other record is reserved
+    //! @returns an empty buffer if the record does not fit, it is counted as dropped
+    Buffer Reserve(ModemOptions::CallbackType type, size_t len);
+    //! Commits the reserved record with the actual length of data
+    void Commit(size_t len);
+
+    //! Passes the records to ModemOptions::DiagnosticRecord as they arrive,
+    //! awaiting each one, the data is referenced directly in the ring
+    async(Drain, ModemOptions& options);
+
+private:
+    struct Header
+    {
+        mono_t time;
+        uint16_t length;
+        ModemOptions::CallbackType type;
+    };
+
+    enum
+    {
+        //! Length marking the rest of the ring as unused
+        Wrap = 0xFFFF,
+    };
+
+    static size_t Align(size_t len) { return (len + 3) & ~3; }
+
+    char* data = NULL;
+    size_t size = 0;
+    //! Free-running byte counters
+    uint32_t written = 0, read = 0;
+    uint32_t dropped = 0;
+    Header* pending = NULL;
+};
+
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/DnsEntry.h
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+#include <collections/SelfLinkedList.h>
+
+namespace gsm
+{
+
+class DnsEntry
+{
+public:
+    const char* Host() const { return (const char*)(this + 1); }
+    const char* Address() const { return address; }
+
+    //! Checks if the entry holds an address that has not expired yet
+    bool IsFresh() const { return valid && OVF_DIFF(expires, MONO_CLOCKS) > 0; }
+
+private:
+    DnsEntry() {}
+
+    DnsEntry* next;
+    mono_t expires;
+    mono_t used;        //!< last lookup, the least recently used entry is evicted first
+    uint8_t lenHost;
+    //! Resolution has been requested
+    bool resolve;
+    bool valid;
+    //! Dotted IPv4 address, longer addresses are not cached
+    char address[16];
+
+    bool Matches(const char* host, size_t len) const { return len == lenHost && !memcmp(Host(), host, len); }
+
+    void Resolved(mono_t ttl)
+    {
+        valid = true;
+        expires = MONO_CLOCKS + ttl;
+    }
+
+    friend class SelfLinkedList<DnsEntry>;
+    friend class Modem;
+    friend class SimComModem;
+};
+
+}
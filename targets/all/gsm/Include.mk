@@ -7,3 +7,4 @@
 #
 
 COMPONENTS += io
+COMPONENTS += nvram
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/LinkEstimator.cpp
+ */
+
+#include <gsm/LinkEstimator.h>
+
+namespace gsm
+{
+
+void LinkEstimator::Sample(size_t length, mono_t time)
+{
+    if (!time)
+    {
+        time = 1;
+    }
+
+    uint32_t bps = std::min(uint64_t(length) * MonoFromSeconds(1) / time, uint64_t(UINT32_MAX));
+
+    if (!samples++)
+    {
+        bandwidth = bps;
+        rtt = time;
+        rttVar = time / 2;
+        return;
+    }
+
+    bandwidth = bandwidth - (bandwidth >> 3) + (bps >> 3);
+
+    mono_t err = time > rtt ? time - rtt : rtt - time;
+    rttVar = rttVar - (rttVar >> 2) + (err >> 2);
+    rtt = rtt - (rtt >> 3) + (time >> 3);
+}
+
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/LinkEstimator.h
+ *
+ * Smoothed estimate of the uplink throughput and acknowledgment time
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace gsm
+{
+
+//! Exponentially weighted moving averages over the data acknowledged by the peer,
+//! the first sample initializes the estimate, every following one moves it by 1/8
+//! (1/4 for the variation), as the TCP round trip time estimator does
+class LinkEstimator
+{
+public:
+    //! Adds data of the specified length acknowledged the specified time after it was sent
+    void Sample(size_t length, mono_t time);
+    //! Clears the estimate, e.g. after the network has changed
+    void Reset() { *this = LinkEstimator(); }
+
+    //! Number of samples so far
+    uint32_t Samples() const { return samples; }
+    //! Estimated throughput in bytes per second, zero without samples
+    uint32_t Bandwidth() const { return bandwidth; }
+    //! Smoothed time from sending the data to its acknowledgment
+    mono_t Rtt() const { return rtt; }
+    //! Mean deviation of the acknowledgment time
+    mono_t RttVariation() const { return rttVar; }
+    unsigned RttMilliseconds() const { return rtt / MonoFromMilliseconds(1); }
+
+private:
+    uint32_t samples = 0;
+    uint32_t bandwidth = 0;
+    mono_t rtt = 0, rttVar = 0;
+};
+
+}
@@ -12,7 +12,10 @@
 #define TRACE_SOCKETS   2
 #define TRACE_DATA      4
 
-#define MODEM_TRACE     TRACE_AT | TRACE_SOCKETS
+// inline text tracing formats everything as it happens, the binary Trace is much cheaper
+#ifndef MODEM_TRACE
+#define MODEM_TRACE     0
+#endif
 
 #define MYDBG(...)      DBGCL("gsm", __VA_ARGS__)
 
@@ -25,6 +28,9 @@
 namespace gsm
 {
 
+//! Invalid command used as a unique marker when resynchronizing, it is only echoed and rejected
+static constexpr ATTemplate atResync("+RESYNC=");
+
 async(Modem::WaitForPowerOn, Timeout timeout)
 async_def_once()
 {
@@ -47,7 +53,7 @@ async_def_once()
 }
 async_end
 
-Socket* Modem::CreateSocket(Span host, uint32_t port, bool tls)
+Socket* Modem::CreateSocket(Span host, uint32_t port, bool tls, bool persistent)
 {
     auto size = SocketSizeImpl();
     auto sock = (Socket*)malloc(size + host.Length() + 1);
@@ -59,7 +65,7 @@ Socket* Modem::CreateSocket(Span host, uint32_t port, bool tls)
     {
         memset(sock + 1, 0, size - sizeof(Socket));
     }
-    sock->flags = SocketFlags::AppReference | (SocketFlags::AppSecure * tls);
+    sock->flags = SocketFlags::AppReference | (SocketFlags::AppSecure * tls) | (SocketFlags::AppPersistent * persistent);
     sock->port = port;
     auto pHost = (char*)sock + size;
     memcpy(pHost, host.Pointer(), host.Length());
@@ -69,12 +75,158 @@ Socket* Modem::CreateSocket(Span host, uint32_t port, bool tls)
     sockets.Append(sock);
     signals |= Signal::RequireActive;
 
+    // make sure the address is resolved before connecting,
+    // TLS connections use the host name, it is needed for SNI and certificate checks
+    if (!tls)
+    {
+        Prefetch(host);
+    }
+
     EnsureRunning();
 
-    MYDBG("Socket %p to %s:%d created", sock, sock->host, sock->port);
+    MYDBG("Socket %p to %s:%d created%s", sock, sock->host, sock->port, persistent ? " (persistent)" : "");
     return sock;
 }
 
+bool Modem::Prefetch(Span host)
+{
+    bool numeric = true;
+    for (char c: host)
+    {
+        if ((c < '0' || c > '9') && c != '.')
+        {
+            numeric = false;
+            break;
+        }
+    }
+
+    if (numeric || host.Length() > 255)
+    {
+        // nothing to resolve
+        return true;
+    }
+
+    auto entry = FindDnsEntry(host.Pointer(), host.Length());
+    if (!entry)
+    {
+        unsigned count = 0;
+        DnsEntry* victim = NULL;
+        for (auto& e: dnsCache)
+        {
+            count++;
+            // entries waiting for resolution are kept, stale addresses go first,
+            // then the ones not used for the longest time
+            if (!e.resolve && (!victim || e.IsFresh() < victim->IsFresh() ||
+                (e.IsFresh() == victim->IsFresh() && OVF_DIFF(e.used, victim->used) < 0)))
+            {
+                victim = &e;
+            }
+        }
+
+        if (count >= DnsCacheSize)
+        {
+            if (!victim)
+            {
+                MYTRACE(TRACE_SOCKETS, "DNS cache full of pending entries, %b not cached", host);
+                return false;
+            }
+
+            for (auto& manip: dnsCache.Manipulate())
+            {
+                if (&manip.Element() == victim)
+                {
+                    manip.Remove();
+                    break;
+                }
+            }
+            MYTRACE(TRACE_SOCKETS, "DNS entry for %s evicted", victim->Host());
+            victim->~DnsEntry();
+            free(victim);
+        }
+
+        entry = (DnsEntry*)malloc(sizeof(DnsEntry) + host.Length() + 1);
+        if (!entry)
+        {
+            return false;
+        }
+
+        new(entry) DnsEntry();
+        entry->resolve = entry->valid = false;
+        entry->lenHost = host.Length();
+        auto pHost = (char*)(entry + 1);
+        memcpy(pHost, host.Pointer(), host.Length());
+        pHost[host.Length()] = 0;
+        dnsCache.Append(entry);
+    }
+
+    entry->used = MONO_CLOCKS;
+
+    if (!entry->IsFresh() && !entry->resolve)
+    {
+        MYTRACE(TRACE_SOCKETS, "Resolving %s", entry->Host());
+        entry->resolve = true;
+        signals |= Signal::RequireActive;
+        EnsureRunning();
+    }
+
+    return true;
+}
+
+void Modem::FlushDnsCache()
+{
+    for (auto& manip: dnsCache.Manipulate())
+    {
+        if (manip.Element().resolve)
+        {
+            // keep pending requests, just forget the address
+            manip.Element().valid = false;
+        }
+        else
+        {
+            auto& e = manip.Remove();
+            e.~DnsEntry();
+            free(&e);
+        }
+    }
+}
+
+DnsEntry* Modem::FindDnsEntry(const char* host, size_t len)
+{
+    for (auto& e: dnsCache)
+    {
+        if (e.Matches(host, len))
+        {
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+const char* Modem::ConnectAddress(Socket& sock)
+{
+    if (sock.IsSecure())
+    {
+        // the modem sends the host name in SNI and checks the certificate against it
+        return sock.host;
+    }
+
+    auto entry = FindDnsEntry(sock.host, strlen(sock.host));
+    if (entry && entry->valid)
+    {
+        entry->used = MONO_CLOCKS;
+        if (!entry->IsFresh() && !entry->resolve)
+        {
+            // a stale address is still better than none, but get a new one for the next connection
+            MYTRACE(TRACE_SOCKETS, "Resolving %s", entry->Host());
+            entry->resolve = true;
+            signals |= Signal::RequireActive;
+        }
+        MYTRACE(TRACE_SOCKETS, "[%p] using cached address %s for %s", &sock, entry->Address(), sock.host);
+        return entry->Address();
+    }
+    return sock.host;
+}
+
 Message* Modem::SendMessage(Span recipient, Span text)
 {
     auto size = MessageSizeImpl();
@@ -110,6 +262,12 @@ void Modem::DestroySocket(Socket* sock)
 {
     ASSERT(!sock->next);
     ASSERT(!sockets.Contains(sock));
+    if (sock == bootSocket)
+    {
+        boots.Leave(false);
+        bootSocket = NULL;
+    }
+    timers.Cancel(*sock);
     MYDBG("Socket %p to %s:%d destroyed", sock, sock->host, sock->port);
     sock->~Socket();
     free(sock);
@@ -159,30 +317,59 @@ void Modem::EnsureRunning()
 
 async(Modem::Task)
 async_def(
-    union { Socket* s; Message* m; };
+    union { Socket* s; Message* m; DnsEntry* d; };
     union { Socket* next; Message* mNext; };
+    const char* deadline;
+    unsigned report;
+    mono_t reconnectAt;
+    bool active, awake, reconnect, idle;
 )
 {
-    // we may not need to run, preprocess sockets to find if there is an active one
-    MYTRACE(TRACE_SOCKETS, "Preprocessing sockets...");
-    for (auto& s: sockets)
+    for (;;)
     {
-        if (!!(s.flags & SocketFlags::AppClose))
-        {
-            // app has requested closure of the socket in the meantime, just mark it closed
-            s.Finished();
-        }
-        else if (s.IsNew())
+        // we may not need to run, preprocess sockets to find if there is an active one
+        MYTRACE(TRACE_SOCKETS, "Preprocessing sockets...");
+        f.next = NULL;
+        f.reconnect = false;
+        for (auto& s: sockets)
         {
-            // the socket is alive and needs processing
-            MYTRACE(TRACE_SOCKETS, "Socket %p is alive, will power on...", &s);
-            f.next = &s;
+            if (!!(s.flags & SocketFlags::AppClose))
+            {
+                // app has requested closure of the socket in the meantime, just mark it closed
+                s.Finished();
+            }
+            else if (s.IsNew())
+            {
+                // the socket is alive and needs processing
+                MYTRACE(TRACE_SOCKETS, "Socket %p is alive, will power on...", &s);
+                f.next = &s;
+            }
+            else if (s.IsReconnecting())
+            {
+                // the socket needs the modem only after its reconnection delay
+                if (!f.reconnect || OVF_DIFF(s.reconnectAt, f.reconnectAt) < 0)
+                {
+                    f.reconnectAt = s.reconnectAt;
+                }
+                f.reconnect = true;
+            }
+            else
+            {
+                // should have been closed already
+                ASSERT(s.IsClosed());
+            }
         }
-        else
+
+        if (f.next || !f.reconnect || messages || DnsPending() || OVF_DIFF(f.reconnectAt, MONO_CLOCKS) <= 0)
         {
-            // should have been closed already
-            ASSERT(s.IsClosed());
+            break;
         }
+
+        // the modem has been stopped after a failure, it is not restarted before
+        // the persistent sockets back off, unless there is something else to do
+        MYDBG("Waiting %d ms before reconnecting", unsigned(OVF_DIFF(f.reconnectAt, MONO_CLOCKS) / MonoFromMilliseconds(1)));
+        process = false;
+        await_mask_not_timeout(process, true, false, Timeout::Absolute(f.reconnectAt));
     }
 
     // destroy old sockets
@@ -205,7 +392,7 @@ async_def(
         }
     }
 
-    if (!f.next && !messages)
+    if (!f.next && !f.reconnect && !messages && !DnsPending())
     {
         MYTRACE(TRACE_SOCKETS, "No active sockets or messages to send, not starting...");
         signals &= ~Signal::TaskActive;
@@ -214,16 +401,21 @@ async_def(
 
     process = true;
 
+    EnterPhase(TaskPhase::PowerOn);
+    boots.Start();
+    boots.Enter(BootPhase::PowerOn);
     PowerDiagnostic(ModemOptions::CallbackType::PowerSend, "ON");
     if (!await(PowerOnImpl))
     {
         PowerDiagnostic(ModemOptions::CallbackType::PowerReceive, "ERR");
         ModemStatus(ModemStatus::PowerOnFailure);
         MYDBG("Power on failed. Will retry in 10 seconds.");
+        boots.Retry();
         async_delay_sec(10);
         if (!await(PowerOnImpl))
         {
             PowerDiagnostic(ModemOptions::CallbackType::PowerReceive, "FAIL");
+            boots.Leave(false);
 
             // finish all sockets
             for (f.s = sockets.First(); f.s && !rxLen; f.s = f.s->next)
@@ -231,6 +423,7 @@ async_def(
                 f.s->Finished();
             }
 
+            EnterPhase(TaskPhase::Off);
             signals &= ~Signal::TaskActive;
             OnTaskStopped();
             async_return(false);
@@ -240,29 +433,81 @@ async_def(
     PowerDiagnostic(ModemOptions::CallbackType::PowerReceive, "ON");
     options.OnPowerOn();
     MYDBG("Starting RX");
+    boots.Enter(BootPhase::RxStart);
     ASSERT(!(signals & (Signal::RxTaskActive | Signal::RxTaskActive)));
     signals |= Signal::RxTaskActive;
     kernel::Task::Run(this, &Modem::RxTask);
 
+    EnterPhase(TaskPhase::Start);
+    boots.Enter(BootPhase::Start);
     if (await(StartImpl))
     {
         ModemStatus(ModemStatus::Ok);
 
+        EnterPhase(TaskPhase::UnlockSim);
+        boots.Enter(BootPhase::UnlockSim);
         if (await(UnlockSimImpl))
         {
             SimStatus(SimStatus::Ok);
 
+            // the implementation may split the rest into registration and GPRS
+            EnterPhase(TaskPhase::Register);
+            boots.Enter(BootPhase::Register);
             if (await(ConnectNetworkImpl))
             {
                 GsmStatus(GsmStatus::Ok);
                 signals |= Signal::NetworkActive;    // allow connections
+                uplink.Reset();     // the estimates of the previous network do not apply
+                EnterPhase(TaskPhase::Active);
+                boots.Leave(true);
+                f.idle = false;
 
-                while (await_acquire_zero(process, 1))
+                for (;;)
                 {
+                    // wait for a processing request or the next socket deadline
+                    await_mask_not_timeout(process, true, false, NextWakeup());
+                    process = false;
+                    signals -= Signal::ReportsPending;
                     MYTRACE(TRACE_SOCKETS, "Processing...");
+                    CheckBootSocket();
+
+                    // handle expired deadlines
+                    for (f.s = timers.Expire(MONO_CLOCKS); f.s; f.s = f.s->wheelNext)
+                    {
+                        f.s->expired = true;
+                    }
+
+                    for (f.s = sockets.First(); f.s && PassContinues(); f.s = f.s->next)
+                    {
+                        if (!f.s->expired)
+                        {
+                            continue;
+                        }
+
+                        f.s->expired = false;
+                        if (f.s->IsReconnecting())
+                        {
+                            if (OVF_DIFF(f.s->reconnectAt, MONO_CLOCKS) <= 0)
+                            {
+                                MYDBG("Reconnecting socket %p, attempt %d", f.s, f.s->retries);
+                                f.s->ReconnectNow();
+                            }
+                        }
+                        else if ((f.deadline = ExpiredDeadline(*f.s)))
+                        {
+                            MYDBG("Socket %p %s timeout, closing", f.s, f.deadline);
+                            f.s->flags |= SocketFlags::ModemClosing;
+                            await(CloseImpl, *f.s);
+                            if (f.s->IsAllocated() && !f.s->IsClosed() && !f.s->IsReconnecting())
+                            {
+                                // release the channel even if the modem did not confirm closing
+                                f.s->Disconnected();
+                            }
+                        }
+                    }
 
                     // disconnect sockets
-                    for (f.s = sockets.First(); f.s && !rxLen; f.s = f.next)
+                    for (f.s = sockets.First(); f.s && PassContinues(); f.s = f.next)
                     {
                         f.next = f.s->next;
                         if (f.s->NeedsClose())
@@ -283,17 +528,46 @@ async_def(
                         }
                     }
 
+                    // resolve requested host names, before any socket tries to connect
+                    for (f.d = dnsCache.First(); f.d && PassContinues(); f.d = f.d->next)
+                    {
+                        if (f.d->resolve)
+                        {
+                            // the previous address stays in use until the new one is known
+                            if (await(ResolveImpl, *f.d))
+                            {
+                                MYDBG("%s resolved to %s", f.d->Host(), f.d->Address());
+                                f.d->Resolved(MonoFromSeconds(dnsCacheSeconds));
+                            }
+                            else if (f.d->valid)
+                            {
+                                MYDBG("Failed to resolve %s, keeping %s", f.d->Host(), f.d->Address());
+                            }
+                            else
+                            {
+                                MYDBG("Failed to resolve %s", f.d->Host());
+                            }
+                            f.d->resolve = false;
+                        }
+                    }
+
                     // process other operations (allocate, connect, send)
-                    for (f.s = sockets.First(); f.s && !rxLen; f.s = f.s->next)
+                    for (f.s = sockets.First(); f.s && PassContinues(); f.s = f.s->next)
                     {
-                        if (!f.s->IsAllocated())
+                        if (!f.s->IsAllocated() && !f.s->IsReconnecting())
                         {
                             TryAllocateImpl(*f.s);
                         }
 
                         if (f.s->NeedsConnect())
                         {
+                            if (boots.Pending(BootPhase::FirstConnect))
+                            {
+                                boots.Enter(BootPhase::FirstConnect);
+                                bootSocket = f.s;
+                            }
                             f.s->flags |= SocketFlags::ModemConnecting;
+                            f.s->connectStart = f.s->lastRx = MONO_CLOCKS;
                             await(ConnectImpl, *f.s);
                         }
 
@@ -304,6 +578,11 @@ async_def(
                             RequestProcessing();
                         }
 
+                        if (f.s->AcksToCheck())
+                        {
+                            await(CheckAcksImpl, *f.s);
+                        }
+
                         if (f.s->DataToReceive())
                         {
                             if (f.s->CanReceive())
@@ -324,7 +603,7 @@ async_def(
                     }
 
                     // send messages
-                    for (f.m = messages.First(); f.m && !rxLen; f.m = f.m->next)
+                    for (f.m = messages.First(); f.m && PassContinues(); f.m = f.m->next)
                     {
                         if (f.m->ShouldSend())
                         {
@@ -346,16 +625,101 @@ async_def(
                         }
                     }
 
+                    // apply changed report settings and query the polled reports
+                    if (reportsChanged && PassContinues())
+                    {
+                        LoadReports();
+                        if (!await(ConfigureReportsImpl))
+                        {
+                            MYDBG("Failed to configure reports");
+                        }
+                    }
+
+                    for (f.report = 0; f.report < ModemOptions::Reports && PassContinues(); f.report++)
+                    {
+                        if (ReportDue(f.report))
+                        {
+                            if (reports[f.report].interval)
+                            {
+                                reportPoll[f.report] = MONO_CLOCKS + MonoFromSeconds(reports[f.report].interval);
+                            }
+                            else
+                            {
+                                reportsScheduled &= ~BIT(f.report);
+                            }
+                            await(PollReportImpl, ModemOptions::Report(f.report));
+                        }
+                    }
+
+                    // schedule socket deadlines
+                    for (auto& s: sockets)
+                    {
+                        ScheduleDeadline(s);
+                    }
+
+                    if (modemStatus == ModemStatus::CommandError)
+                    {
+                        // a response has been lost, try to recover without dropping the connection
+                        MYDBG("AT sequence broken, resynchronizing");
+                        if (!await(Resync))
+                        {
+                            MYDBG("Resynchronization failed");
+                            break;
+                        }
+                        // finish the operations skipped after the error
+                        RequestProcessing();
+                    }
+
                     if (atResult != ATResult::OK)
                     {
                         MYDBG("AT sequence broken");
                         break;
                     }
 
-                    if (!sockets && !messages)
+                    if (!sockets && !messages && !DnsPending())
                     {
                         signals -= Signal::RequireActive;
-                        if (!await_mask_not_timeout(signals, Signal::RequireActive, 0, powerOffTimeout))
+                        if (!f.idle)
+                        {
+                            f.idle = true;
+                            idleSince = MONO_CLOCKS;
+                        }
+
+                        // the waits also end when a polled report is due or requested,
+                        // the idle time keeps running while it is processed
+                        if (!sleepTimeout.IsInfinite() &&
+                            (await_mask_not_timeout(signals, Signal::RequireActive | Signal::ReportsPending, 0, IdleTimeout(0, sleepTimeout)) ||
+                                !IdleExpired(0, sleepTimeout)))
+                        {
+                            continue;
+                        }
+
+                        if (!sleepTimeout.IsInfinite() && await(SleepImpl))
+                        {
+                            // registration and PDP context are kept while sleeping
+                            MYDBG("No activity for a while, modem sleeping");
+                            signals |= Signal::Sleeping;
+                            EnterPhase(TaskPhase::Sleep);
+                            f.active = await_mask_not_timeout(signals, Signal::RequireActive | Signal::ReportsPending, 0, IdleTimeout(PowerOffDelay(), powerOffTimeout)) ||
+                                !IdleExpired(PowerOffDelay(), powerOffTimeout);
+                            f.awake = await(WakeImpl);
+                            signals -= Signal::Sleeping;
+                            EnterPhase(TaskPhase::Active);
+                            if (!f.awake)
+                            {
+                                MYDBG("Failed to wake up modem");
+                                break;
+                            }
+                            if (!f.active)
+                            {
+                                MYDBG("No activity for a while, turning off modem");
+                                process = false;
+                                break;
+                            }
+                            MYDBG("Modem awake");
+                        }
+                        else if (!await_mask_not_timeout(signals, Signal::RequireActive | Signal::ReportsPending, 0, IdleTimeout(PowerOffDelay(), powerOffTimeout)) &&
+                            IdleExpired(PowerOffDelay(), powerOffTimeout))
                         {
                             MYDBG("No activity for a while, turning off modem");
                             // further processing requests will force the modem to restart
@@ -365,22 +729,37 @@ async_def(
                     }
                     else
                     {
+                        f.idle = false;
                         async_yield();
                     }
                 }
 
                 signals = (signals & ~Signal::NetworkActive) | Signal::NetworkDisconnecting;   // disable further connections
+                EnterPhase(TaskPhase::Disconnect);
                 await(DisconnectNetworkImpl);
             }
         }
 
+        EnterPhase(TaskPhase::Stop);
         await(StopImpl);
     }
 
-    // finish all sockets
+    // a phase still running has been interrupted by a failure
+    boots.Leave(false);
+    bootSocket = NULL;
+    EnterPhase(TaskPhase::Stop);
+
+    // finish all sockets, persistent ones will be reconnected after restart
     for (f.s = sockets.First(); f.s && !rxLen; f.s = f.s->next)
     {
-        f.s->Finished();
+        if (f.s->IsReconnecting())
+        {
+            RequestProcessing();
+        }
+        else if (!f.s->IsClosed())
+        {
+            f.s->Lost();
+        }
     }
 
     PowerDiagnostic(ModemOptions::CallbackType::PowerSend, "OFF");
@@ -391,6 +770,7 @@ async_def(
 
     await_mask(signals, Signal::RxTaskActive, 0);
 
+    EnterPhase(TaskPhase::Off);
     signals &= ~Signal::TaskActive;
     OnTaskStopped();
     MYDBG("Stopped");
@@ -406,28 +786,46 @@ async(Modem::RxTask)
 async_def(
     FNV1a hash;
     size_t len;
+    mono_t lineStart;
+    uint8_t complete;
 )
 {
     while (await(rx.Require))
     {
+        RxWaitEnd();
+        // unsolicited lines and socket data may arrive while a command is pending,
+        // only what is routed to the command counts as the start of its response
+        f.lineStart = rxBusyFrom;
         // need at least one character
         switch (rx.Peek(0))
         {
             case '>':
                 rx.Advance(1);
+                if (atResult == ATResult::Pending)
+                {
+                    ATResponding(f.lineStart);
+                }
                 if (atTransmitSock)
                 {
                     MYTRACE(TRACE_SOCKETS, "[%p] >> sending %d+%d=%d", atTransmitSock, atTransmitSock->OutputReader().Position(), atTransmitLen, atTransmitSock->OutputReader().Position() + atTransmitLen);
-                    UNUSED size_t sent = await(atTransmitSock->OutputReader().CopyTo, tx, 0, atTransmitLen);
+                    trace.Add(Trace::Category::Sockets, Trace::Event::Transmit, uint32_t(uintptr_t(atTransmitSock)), atTransmitLen);
+                    // the data still waiting for the acknowledgment of the peer is skipped
+                    RxWaitBegin();
+                    UNUSED size_t sent = await(atTransmitSock->OutputReader().CopyTo, tx, atTransmitSock->inFlight, atTransmitLen);
+                    RxWaitEnd();
                     ASSERT(sent == atTransmitLen);
+                    atTransmitSock->counters.sent += atTransmitLen;
+                    counters.sent += atTransmitLen;
                     atTransmitSock = NULL;
                 }
                 else if (atTransmitMsg)
                 {
                     MYTRACE(TRACE_SOCKETS, "[%p] >> sending message %b", atTransmitMsg, atTransmitMsg->Text());
+                    RxWaitBegin();
                     UNUSED size_t sent = await(tx.Write, atTransmitMsg->Text());
                     ASSERT(sent == atTransmitMsg->Text().Length());
                     sent = await(tx.Write, BYTES(26));   // send CTRL+Z
+                    RxWaitEnd();
                     ASSERT(sent);
                     atTransmitMsg = NULL;
                 }
@@ -446,7 +844,9 @@ async_def(
 
             default:
                 // EOL-terminated command
+                RxWaitBegin();
                 size_t len = await(rx.RequireUntil, '\r');
+                RxWaitEnd();
                 if (!len)
                 {
                     if (rx.IsComplete())
@@ -458,57 +858,29 @@ async_def(
                 }
 
                 lineEnd = rx.Position() + len;
+                rxLast = MONO_CLOCKS;
 #if TRACE && (MODEM_TRACE & TRACE_AT)
                 DBGC("gsm", "<< ");
                 for (char c: rx.Enumerate(len - 1)) _DBGCHAR(c);
                 _DBGCHAR('\n');
 #endif
-                if (Buffer buf = options.GetDiagnosticBuffer(ModemOptions::CallbackType::CommandReceive))
+                if (Buffer buf = DiagnosticBuffer(ModemOptions::CallbackType::CommandReceive, len - 1))
                 {
-                    options.DiagnosticCallback(ModemOptions::CallbackType::CommandReceive, rx.Peek(buf.Left(len - 1)));
+                    // copied straight from the pipe
+                    DiagnosticDone(ModemOptions::CallbackType::CommandReceive, rx.Peek(buf.Left(len - 1)));
                 }
-                FNV1a hash;
-                auto iter = rx.Enumerate(len - 1);
-                bool digitsOnly = true;
-                while (iter && *iter != ':')
-                {
-                    if (*iter == ',')
-                    {
-                        if (digitsOnly)
-                        {
-                            // calculate hash only for text after the comma
-                            // for events with channel, such as "0, CONNECT OK"
-                            ++iter;
-                            if (iter && *iter == ' ')
-                            {
-                                ++iter;
-                            }
-                            hash = FNV1a();
-                            continue;
-                        }
-                        else
-                        {
-                            // terminate at comma, include it in the event hash
-                            // to disambiguate
-                            hash += ',';
-                            ++iter;
-                            break;
-                        }
-                    }
-                    else if (*iter < '0' || *iter > '9')
-                    {
-                        digitsOnly = false;
-                    }
+                io::Pipe::Iterator iter = rx.Enumerate(len - 1);
+                FNV1a hash = HashHeader(iter);
+                counters.lines++;
 
-                    hash += *iter;
-                    ++iter;
-                }
+                trace.Add(Trace::Category::Events, Trace::Event::Line, hash, len - 1);
 
                 switch (hash)
                 {
                     case fnv1a("OK"):
                         if (atResult == ATResult::Pending)
                         {
+                            ATResponding(f.lineStart);
                             ATComplete();
                         }
                         else
@@ -522,8 +894,11 @@ async_def(
                     case fnv1a("+CMS ERROR"):
                         if (int(atResult) < 0)
                         {
+                            ATResponding(f.lineStart);
                             atResult = ATResult::Error;
+                            RxWaitBegin();
                             async_yield();  // let the task sending the command see the error
+                            RxWaitEnd();
                         }
                         else
                             MYDBG("!! Unexpected Error");
@@ -540,7 +915,18 @@ async_def(
                         }
                         lineFields = iter;
                         f.hash = hash;
-                        if (!await(OnEvent, f.hash))
+                        // some events complete the pending command instead of OK
+                        f.complete = atResult == ATResult::Pending ? atComplete : 0xFF;
+                        if (await(OnEvent, f.hash))
+                        {
+                            if (f.complete != 0xFF && (atComplete != f.complete || atResult != ATResult::Pending))
+                            {
+                                ATResponding(f.lineStart);
+                            }
+                            counters.Event(f.hash);
+                            CheckBootSocket();
+                        }
+                        else
                         {
                             if (int(atResult) >= 0) // not pending
                             {
@@ -552,6 +938,7 @@ async_def(
                             }
                             else
                             {
+                                ATResponding(f.lineStart);
                                 await(atResponse, f.hash);
                             }
                         }
@@ -561,7 +948,10 @@ async_def(
                 if (rxLen)
                 {
                     // skip '\n'
-                    if (await(rx.Require))
+                    RxWaitBegin();
+                    f.len = await(rx.Require);
+                    RxWaitEnd();
+                    if (f.len)
                     {
                         if (rx.Peek(0) != '\n')
                         {
@@ -570,6 +960,7 @@ async_def(
                         rx.Advance(1);
                     }
 
+                    trace.Add(Trace::Category::Sockets, Trace::Event::Receive, uint32_t(uintptr_t(rxSock)), rxLen);
                     if (rxSock)
                     {
                         MYTRACE(TRACE_SOCKETS, "[%p] << receiving %d+%d=%d", rxSock, rxSock->InputWriter().Position(), rxLen, rxSock->InputWriter().Position() + rxLen);
@@ -585,7 +976,10 @@ async_def(
                         while (rx.Available() < rxLen && !rx.AvailableFullSegment())
                         {
                             f.len = rx.Available() + 1;
-                            if (!await(rx.Require, f.len))
+                            RxWaitBegin();
+                            f.len = await(rx.Require, f.len);
+                            RxWaitEnd();
+                            if (!f.len)
                             {
                                 break;
                             }
@@ -597,9 +991,15 @@ async_def(
                             break;
                         }
                         MYTRACE(TRACE_DATA, "[%p] [%d@%p] << %H", rxSock, rx.Position(), rx.GetSpan().Pointer(), rx.GetSpan().Left(f.len));
+                        trace.Add(Trace::Category::Data, Trace::Event::Segment, uint32_t(uintptr_t(rxSock)), f.len);
                         if (rxSock)
                         {
+                            rxSock->lastRx = MONO_CLOCKS;
+                            rxSock->counters.received += f.len;
+                            counters.received += f.len;
+                            RxWaitBegin();
                             await(rx.MoveTo, rxSock->InputWriter(), f.len);
+                            RxWaitEnd();
                             MYTRACE(TRACE_SOCKETS, "[%p] << received %d+%d=%d", rxSock, rxSock->InputWriter().Position() - io::PipePosition() - f.len, f.len, rxSock->InputWriter().Position());
                         }
                         else
@@ -616,6 +1016,8 @@ async_def(
                 }
                 break;
         }
+
+        RxWaitBegin();
     }
 
     MYDBG("RX Stopped");
@@ -639,11 +1041,13 @@ async_def()
         // we cannot continue executing commands once a command failed,
         // as the ordering in the AT protocol can be broken
         atResult = ATResult::Failure;
+        counters.failures++;
         async_return(true);
     }
 
     await_acquire(signals, Signal::ATLock);
     atTask = &kernel::Task::Current();
+    atLockSince = atLockCounted = MONO_CLOCKS;
     atResult = ATResult::Pending;
     atRequire = 1;
     atComplete = 0;
@@ -651,6 +1055,16 @@ async_def()
 }
 async_end
 
+void Modem::ATRelease()
+{
+    if (atTask)
+    {
+        counters.atLockTime += MONO_CLOCKS - atLockCounted;
+    }
+    atTask = NULL;
+    signals &= ~Signal::ATLock;
+}
+
 async(Modem::AT, Span cmd)
 async_def()
 {
@@ -660,16 +1074,8 @@ async_def()
     }
 
     MYTRACE(TRACE_AT, ">> AT%b", cmd);
-
-    if (Buffer buf = options.GetDiagnosticBuffer(ModemOptions::CallbackType::CommandSend))
-    {
-        if (buf.Length() >= 2)
-        {
-            buf.Element<uint16_t>() = *(uint16_t*)"AT";
-            cmd.CopyTo(buf.RemoveLeft(2));
-            options.DiagnosticCallback(ModemOptions::CallbackType::CommandSend, buf.Left(cmd.Length() + 2));
-        }
-    }
+    DiagnosticCommand(cmd);
+    ATStart(ATStats::Key(cmd));
 
     if (await(tx.Write, "AT") != 2 ||
         await(tx.Write, cmd) != (int)cmd.Length() ||
@@ -677,9 +1083,9 @@ async_def()
     {
         atNextTimeout = Timeout::Infinite;
         atResponse = {};
-        atTask = NULL;
-        signals &= ~Signal::ATLock;
+        ATRelease();
         ModemStatus(ModemStatus::CommandError);
+        counters.failures++;
         async_return(int(atResult = ATResult::Failure));
     }
 
@@ -695,6 +1101,8 @@ async_def()
         async_return(int(ATResult::Failure));
     }
 
+    ATStart(ATStats::Key(format, format ? strlen(format) : 0));
+
 #if TRACE && (MODEM_TRACE & TRACE_AT)
     DBGC("gsm", ">> AT");
     va_list va2;
@@ -704,7 +1112,7 @@ async_def()
     _DBGCHAR('\n');
 #endif
 
-    if (Buffer buf = options.GetDiagnosticBuffer(ModemOptions::CallbackType::CommandSend))
+    if (Buffer buf = DiagnosticBuffer(ModemOptions::CallbackType::CommandSend, MaxDiagnosticCommand))
     {
         if (buf.Length() >= 2)
         {
@@ -712,7 +1120,11 @@ async_def()
             va_copy(va3, va);
             buf.Element<uint16_t>() = *(uint16_t*)"AT";
             auto res = buf.RemoveLeft(2).FormatVA(format, va3);
-            options.DiagnosticCallback(ModemOptions::CallbackType::CommandSend, Buffer(buf.Pointer(), res.end()));
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, Buffer(buf.Pointer(), res.end()));
+        }
+        else
+        {
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, Buffer());
         }
     }
 
@@ -722,9 +1134,9 @@ async_def()
     {
         atNextTimeout = Timeout::Infinite;
         atResponse = {};
-        atTask = NULL;
-        signals &= ~Signal::ATLock;
+        ATRelease();
         ModemStatus(ModemStatus::CommandError);
+        counters.failures++;
         async_return(int(atResult = ATResult::Failure));
     }
 
@@ -732,6 +1144,264 @@ async_def()
 }
 async_end
 
+async(Modem::ATCommand, Span prefix, ATArgs args)
+async_def()
+{
+    if (await(ATLock))
+    {
+        async_return(int(ATResult::Failure));
+    }
+
+    if (!args.IsValid())
+    {
+        // nothing has been sent yet, so the AT protocol is still in sync
+        MYDBG("Arguments of %b do not fit", prefix);
+        atNextTimeout = Timeout::Infinite;
+        atResponse = {};
+        atTransmitSock = NULL;
+        atTransmitMsg = NULL;
+        ATRelease();
+        counters.failures++;
+        async_return(int(atResult = ATResult::Failure));
+    }
+
+    MYTRACE(TRACE_AT, ">> %b%b", prefix, args.Get());
+    // the prefix starts with AT
+    ATStart(ATStats::Key((const char*)prefix.Pointer() + 2, prefix.Length() - 2));
+
+    if (Buffer buf = DiagnosticBuffer(ModemOptions::CallbackType::CommandSend, prefix.Length() + args.Get().Length()))
+    {
+        // the command is already complete, just copy it
+        if (buf.Length() >= prefix.Length() + args.Get().Length())
+        {
+            prefix.CopyTo(buf);
+            args.Get().CopyTo(buf.RemoveLeft(prefix.Length()));
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, buf.Left(prefix.Length() + args.Get().Length()));
+        }
+        else
+        {
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, Buffer());
+        }
+    }
+
+    if (await(tx.Write, prefix) != (int)prefix.Length() ||
+        await(tx.Write, args.Get()) != (int)args.Get().Length() ||
+        await(tx.Write, "\r") != 1)
+    {
+        atNextTimeout = Timeout::Infinite;
+        atResponse = {};
+        ATRelease();
+        ModemStatus(ModemStatus::CommandError);
+        counters.failures++;
+        async_return(int(atResult = ATResult::Failure));
+    }
+
+    async_return(await(ATResponse));
+}
+async_end
+
+async(Modem::ATBatch, const Span* cmds, size_t count, ATResult* results)
+async_def(
+    size_t i;
+    ATResult res;
+)
+{
+    f.res = ATResult::Error;
+
+    if (count > 1)
+    {
+        if (await(ATLock))
+        {
+            f.res = ATResult::Failure;
+        }
+        else
+        {
+            // the latency of the whole line says nothing about the single commands,
+            // it is not recorded and the default timeout applies
+            ATStart(0);
+
+            for (f.i = 0; f.i < count; f.i++)
+            {
+                MYTRACE(TRACE_AT, ">> %s%b", f.i ? ";" : "AT", cmds[f.i]);
+                DiagnosticCommand(cmds[f.i]);
+
+                if (await(tx.Write, f.i ? ";" : "AT") != 1 + !f.i ||
+                    await(tx.Write, cmds[f.i]) != (int)cmds[f.i].Length())
+                {
+                    break;
+                }
+            }
+
+            if (f.i < count || await(tx.Write, "\r") != 1)
+            {
+                atNextTimeout = Timeout::Infinite;
+                atResponse = {};
+                ATRelease();
+                ModemStatus(ModemStatus::CommandError);
+                counters.failures++;
+                f.res = atResult = ATResult::Failure;
+            }
+            else
+            {
+                f.res = (ATResult)await(ATResponse);
+            }
+        }
+
+        if (f.res != ATResult::Error)
+        {
+            // a single final result applies to all commands, after a timeout
+            // the command sequence is broken and the commands cannot be retried
+            for (f.i = 0; results && f.i < count; f.i++)
+            {
+                results[f.i] = f.res;
+            }
+            async_return(int(f.res));
+        }
+
+        // the commands before the failed one have been executed already,
+        // but there is no way to tell which one failed
+        MYDBG("Combined command failed, executing commands one by one");
+        counters.retries += count;
+    }
+
+    for (f.i = 0, f.res = ATResult::OK; f.i < count; f.i++)
+    {
+        if (f.res == ATResult::OK)
+        {
+            f.res = (ATResult)await(AT, cmds[f.i]);
+            if (results)
+            {
+                results[f.i] = f.res;
+            }
+        }
+        else if (results)
+        {
+            // not executed after a failure
+            results[f.i] = ATResult::Failure;
+        }
+    }
+    async_return(int(f.res));
+}
+async_end
+
+Timeout Modem::ATAdaptiveTimeout() const
+{
+    unsigned ms = atStats.Percentile(atKey, 990);
+    if (!ms)
+    {
+        // not enough history for this command yet
+        return atTimeout;
+    }
+
+    // leave some margin above the slowest observed responses
+    return Timeout::Milliseconds(std::min(std::max(ms * 2, atTimeoutMinMs), atTimeoutMaxMs));
+}
+
+void Modem::DiagnosticCommand(Span cmd)
+{
+    if (Buffer buf = DiagnosticBuffer(ModemOptions::CallbackType::CommandSend, cmd.Length() + 2))
+    {
+        if (buf.Length() >= 2)
+        {
+            buf.Element<uint16_t>() = *(uint16_t*)"AT";
+            cmd.CopyTo(buf.RemoveLeft(2));
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, buf.Left(cmd.Length() + 2));
+        }
+        else
+        {
+            DiagnosticDone(ModemOptions::CallbackType::CommandSend, Buffer());
+        }
+    }
+}
+
+async(Modem::Resync)
+async_def(
+    Modem* self;
+    ATArgs marker;
+    uint32_t hash;
+    unsigned attempt, wait;
+    bool seen;
+
+    async(OnEcho, FNV1a header)
+    async_def_sync()
+    {
+        // echoed command lines, only the marker is of interest
+        if (header == hash)
+        {
+            seen = true;
+        }
+    }
+    async_end
+)
+{
+    f.self = this;
+
+    // the prompt for data will not come anymore
+    atTransmitSock = NULL;
+    atTransmitMsg = NULL;
+
+    for (f.attempt = 0; f.attempt < 3; f.attempt++)
+    {
+        // let the responses to earlier commands arrive
+        for (f.wait = 0; f.wait < 50 && OVF_DIFF(MONO_CLOCKS, rxLast) < MonoFromMilliseconds(100); f.wait++)
+        {
+            async_delay_ms(20);
+        }
+
+        ModemStatus(ModemStatus::Ok);
+        counters.resyncs++;
+
+        // the modem processes commands in order, once the marker is echoed back,
+        // everything sent before it has been answered
+        f.marker = ATArgs().Int(++resyncCount);
+        {
+            FNV1a hash;
+            auto prefix = atResync.Prefix();
+            for (size_t i = 0; i < prefix.Length(); i++)
+            {
+                hash += ((const char*)prefix.Pointer())[i];
+            }
+            for (size_t i = 0; i < f.marker.Get().Length(); i++)
+            {
+                hash += ((const char*)f.marker.Get().Pointer())[i];
+            }
+            f.hash = hash;
+        }
+        f.seen = false;
+
+        if (await(ATLock) ||
+            NextATTimeout(Timeout::Milliseconds(500)) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnEcho)) ||
+            await(AT, "E1") == int(ATResult::Timeout) ||
+            await(ATLock) ||
+            NextATTimeout(Timeout::Milliseconds(500)) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnEcho)) ||
+            await(ATCommand, atResync.Prefix(), f.marker) == int(ATResult::Timeout) ||
+            !f.seen)
+        {
+            MYDBG("Resync attempt %d failed", f.attempt + 1);
+            continue;
+        }
+
+        // the marker has been answered, turn the echo off again
+        if (await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnEcho)) ||
+            await(AT, "E0"))
+        {
+            continue;
+        }
+
+        MYDBG("AT channel resynchronized");
+        trace.Add(Trace::Category::AT, Trace::Event::Resync, f.attempt + 1, 0, true);
+        async_return(true);
+    }
+
+    trace.Add(Trace::Category::AT, Trace::Event::Resync, f.attempt, 0, false);
+    ModemStatus(ModemStatus::CommandError);
+    async_return(false);
+}
+async_end
+
 async(Modem::ATResponse)
 async_def(
     Timeout timeout;
@@ -740,22 +1410,176 @@ async_def(
     ASSERT(signals & Signal::ATLock);
     ASSERT(atTask == &kernel::Task::Current());
 
-    f.timeout = (atNextTimeout || atTimeout).MakeAbsolute();
+    f.timeout = (atNextTimeout || ATAdaptiveTimeout()).MakeAbsolute();
     atNextTimeout = Timeout::Infinite;
+    // the whole command is in the transmit pipe now, the time it waited
+    // for room in the pipe is not part of the latency of the modem
+    atStart = MONO_CLOCKS;
 
     if (!await_mask_not_timeout(atResult, 0x80, 0x80, f.timeout))
     {
         ModemStatus(ModemStatus::CommandError);
         atResult = ATResult::Timeout;
+        counters.timeouts++;
+    }
+    else
+    {
+        mono_t latency = MONO_CLOCKS - atStart, first = latency;
+        if (atFirstByte)
+        {
+            // the response may start arriving before the writing task gets here
+            first = OVF_DIFF(atFirstByteAt, atStart) > 0 ? atFirstByteAt - atStart : 0;
+        }
+        if (atKey)
+        {
+            atStats.Record(atKey, latency, first);
+        }
+        if (atResult == ATResult::Error)
+        {
+            counters.errors++;
+        }
     }
 
+    trace.Add(Trace::Category::AT, Trace::Event::Result, (MONO_CLOCKS - atStart) / MonoFromMilliseconds(1), 0, uint8_t(atResult));
+
     atResponse = {};
-    atTask = NULL;
-    signals &= ~Signal::ATLock;
+    ATRelease();
     async_return(int(atResult));
 }
 async_end
 
+ModemCounters Modem::Counters() const
+{
+    ModemCounters res = counters;
+    mono_t now = MONO_CLOCKS;
+    res.phaseTime[unsigned(phase)] += now - phaseSince;
+    if (atTask)
+    {
+        res.atLockTime += now - atLockCounted;
+    }
+    return res;
+}
+
+void Modem::ResetCounters()
+{
+    counters = {};
+    phaseSince = atLockCounted = MONO_CLOCKS;
+}
+
+void Modem::CheckBootSocket()
+{
+    if (bootSocket && !bootSocket->IsConnecting())
+    {
+        boots.Leave(bootSocket->IsConnected());
+        bootSocket = NULL;
+    }
+}
+
+void Modem::PollReport(ModemOptions::Report report)
+{
+    if (reports[unsigned(report)].mode == ModemOptions::ReportMode::Polled)
+    {
+        reportPoll[unsigned(report)] = MONO_CLOCKS;
+        reportsScheduled |= BIT(unsigned(report));
+        if (IsActive())
+        {
+            signals |= Signal::ReportsPending;
+            RequestProcessing();
+        }
+    }
+}
+
+void Modem::LoadReports()
+{
+    reportsChanged = false;
+    reportsScheduled = 0;
+    for (unsigned i = 0; i < ModemOptions::Reports; i++)
+    {
+        reports[i] = options.UseReport(ModemOptions::Report(i));
+        if (reports[i].mode == ModemOptions::ReportMode::Polled)
+        {
+            // the first query follows right after the change
+            reportPoll[i] = MONO_CLOCKS;
+            reportsScheduled |= BIT(i);
+        }
+    }
+}
+
+Timeout Modem::NextWakeup() const
+{
+    mono_t next;
+    bool any = timers.NextTime(next);
+    for (unsigned i = 0; i < ModemOptions::Reports; i++)
+    {
+        if ((reportsScheduled & BIT(i)) && (!any || OVF_DIFF(reportPoll[i], next) < 0))
+        {
+            next = reportPoll[i];
+            any = true;
+        }
+    }
+    return any ? Timeout::Absolute(next) : Timeout::Infinite;
+}
+
+Timeout Modem::IdleTimeout(mono_t delay, Timeout length) const
+{
+    Timeout next = NextWakeup();
+    if (length.IsInfinite())
+    {
+        return next;
+    }
+
+    mono_t end = idleSince + delay + Ticks(length);
+    return !next.IsInfinite() && OVF_DIFF(next.ToMono(), end) < 0 ? next : Timeout::Absolute(end);
+}
+
+void Modem::EnterPhase(TaskPhase phase)
+{
+    mono_t now = MONO_CLOCKS;
+    counters.phaseTime[unsigned(this->phase)] += now - phaseSince;
+    phaseSince = now;
+    this->phase = phase;
+}
+
+FNV1a Modem::HashHeader(io::Pipe::Iterator& iter)
+{
+    FNV1a hash;
+    bool digitsOnly = true;
+    while (iter && *iter != ':')
+    {
+        if (*iter == ',')
+        {
+            if (digitsOnly)
+            {
+                // calculate hash only for text after the comma
+                // for events with channel, such as "0, CONNECT OK"
+                ++iter;
+                if (iter && *iter == ' ')
+                {
+                    ++iter;
+                }
+                hash = FNV1a();
+                continue;
+            }
+            else
+            {
+                // terminate at comma, include it in the event hash
+                // to disambiguate
+                hash += ',';
+                ++iter;
+                break;
+            }
+        }
+        else if (*iter < '0' || *iter > '9')
+        {
+            digitsOnly = false;
+        }
+
+        hash += *iter;
+        ++iter;
+    }
+    return hash;
+}
+
 unsigned Modem::InputFieldCount() const
 {
     unsigned n = 0;
@@ -867,12 +1691,110 @@ async_def()
 }
 async_end
 
+bool Modem::SocketDeadline(Socket& sock, mono_t& at)
+{
+    bool any = false;
+    auto consider = [&](mono_t t) { if (!any || OVF_DIFF(t, at) < 0) { at = t; any = true; } };
+
+    if (sock.IsReconnecting())
+    {
+        consider(sock.reconnectAt);
+    }
+    else if (sock.IsConnecting())
+    {
+        if (!connectTimeout.IsInfinite())
+        {
+            consider(sock.connectStart + Ticks(connectTimeout));
+        }
+    }
+    else if (sock.IsConnected() && !(sock.flags & SocketFlags::ModemClosing))
+    {
+        if (!idleTimeout.IsInfinite())
+        {
+            consider(sock.lastRx + Ticks(idleTimeout));
+        }
+
+        if (!sendTimeout.IsInfinite() && sock.OutputReader().Available())
+        {
+            consider(sock.lastTx + Ticks(sendTimeout));
+        }
+
+        if (sock.inFlight)
+        {
+            consider(sock.ackCheckAt);
+        }
+    }
+
+    return any;
+}
+
+const char* Modem::ExpiredDeadline(Socket& sock)
+{
+    mono_t now = MONO_CLOCKS;
+
+    if (sock.IsConnecting())
+    {
+        if (!connectTimeout.IsInfinite() && OVF_DIFF(sock.connectStart + Ticks(connectTimeout), now) <= 0)
+        {
+            return "connect";
+        }
+    }
+    else if (sock.IsConnected() && !(sock.flags & SocketFlags::ModemClosing))
+    {
+        if (!idleTimeout.IsInfinite() && OVF_DIFF(sock.lastRx + Ticks(idleTimeout), now) <= 0)
+        {
+            return "idle";
+        }
+
+        if (!sendTimeout.IsInfinite() && sock.OutputReader().Available() && OVF_DIFF(sock.lastTx + Ticks(sendTimeout), now) <= 0)
+        {
+            return "send";
+        }
+    }
+
+    return NULL;
+}
+
+void Modem::ScheduleDeadline(Socket& sock)
+{
+    // the send deadline is measured from the last progress of the output
+    int pos = unsafe_cast<int>(sock.OutputReader().Position());
+    if (pos != sock.txPos || !sock.OutputReader().Available())
+    {
+        sock.txPos = pos;
+        sock.lastTx = MONO_CLOCKS;
+    }
+
+    mono_t at;
+    if (SocketDeadline(sock, at))
+    {
+        // timers may fire early, so only an earlier deadline needs rescheduling
+        if (!timers.IsScheduled(sock) || OVF_DIFF(at, sock.wheelAt) < 0)
+        {
+            timers.Schedule(sock, at);
+        }
+    }
+}
+
 void Modem::PowerDiagnostic(ModemOptions::CallbackType type, Span msg)
 {
-    if (Buffer buf = options.GetDiagnosticBuffer(type))
+    if (Buffer buf = DiagnosticBuffer(type, msg.Length()))
     {
-        options.DiagnosticCallback(type, msg.CopyTo(buf));
+        DiagnosticDone(type, msg.CopyTo(buf));
     }
 }
 
+void Modem::CaptureDiagnostics(Buffer storage)
+{
+    diagnostics.Init(storage);
+    kernel::Task::Run(this, &Modem::DiagnosticTask);
+}
+
+async(Modem::DiagnosticTask)
+async_def()
+{
+    await(diagnostics.Drain, options);
+}
+async_end
+
 }
@@ -17,6 +17,14 @@
 
 #include "Socket.h"
 #include "Message.h"
+#include "DnsEntry.h"
+#include "TimerWheel.h"
+#include "ATTemplate.h"
+#include "ATStats.h"
+#include "Trace.h"
+#include "Counters.h"
+#include "BootHistory.h"
+#include "DiagnosticRing.h"
 #include "ModemOptions.h"
 
 namespace gsm
@@ -95,24 +103,104 @@ public:
     const class NetworkInfo& NetworkInfo() const { return netInfo; }
 
     bool IsActive() const { return !!(signals & Signal::TaskActive); }
+    bool IsSleeping() const { return !!(signals & Signal::Sleeping); }
     bool IsDisconnecting() const { return !!(signals & Signal::NetworkDisconnecting); }
 
     int Rssi() const { return rssi; }
-
+    //! Total time spent by RxTask processing received data, excluding the time
+    //! it waits for more data or for the consumers of the data, wraps around like MONO_CLOCKS
+    mono_t RxBusyTime() const { return rxBusy; }
+
+    //! Gets a copy of the activity counters, including the time spent in the current
+    //! phase and the current hold of the AT lock
+    ModemCounters Counters() const;
+    //! Clears the activity counters, the counters of individual sockets are kept
+    void ResetCounters();
+    //! Current phase of the modem task
+    TaskPhase Phase() const { return phase; }
+    //! Time for which the current owner has been holding the AT lock, zero if not locked
+    mono_t ATLockHeld() const { return atTask ? MONO_CLOCKS - atLockSince : 0; }
+    //! Estimated uplink throughput and acknowledgment time over all sockets,
+    //! cleared when the modem registers to a network again, see Socket::Uplink
+    const LinkEstimator& Uplink() const { return uplink; }
+    //! Applies changed ModemOptions::UseReport settings, the modem is reconfigured
+    //! the next time it is processing, a stopped modem uses them when it starts
+    void ReconfigureReports() { reportsChanged = true; if (IsActive()) { signals |= Signal::ReportsPending; RequestProcessing(); } }
+    //! Queries a polled report the next time the modem is processing,
+    //! an idle or sleeping modem is woken up for it
+    void PollReport(ModemOptions::Report report);
+    //! Report setting in effect, as last read from ModemOptions::UseReport
+    ModemOptions::ReportSetting ReportSetting(ModemOptions::Report report) const { return reports[unsigned(report)]; }
+    //! Timing of the phases of the recent modem starts
+    const class BootHistory& BootHistory() const { return boots; }
+
+    //! Gets the binary trace of modem activity, see Trace::Enable and Trace::Drain
+    class Trace& Trace() { return trace; }
+    //! Captures diagnostic records into a ring in the specified memory instead of calling
+    //! ModemOptions::DiagnosticCallback directly, the records are passed to
+    //! ModemOptions::DiagnosticRecord from a separate task; received lines are still copied
+    //! from the RX pipe into the ring, as the pipe cannot hold them for the consumer
+    void CaptureDiagnostics(Buffer storage);
+    //! Number of diagnostic records lost because the consumer was too slow
+    uint32_t DiagnosticsDropped() const { return diagnostics.Dropped(); }
+
+    //! Latency histograms of the commands, keyed by ATStats::Key of the command,
+    //! e.g. ATStats::Key("+CSQ"), for response time monitoring
+    const ATStats& ATStatistics() const { return atStats; }
+    //! Response timeout of commands without enough latency history
     Timeout ATTimeout() const { return atTimeout; }
     void ATTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); atTimeout = timeout; }
+    //! Response timeout of commands whose result depends on the network, e.g. connecting
+    //! and sending, it is not derived from the observed latency, as the network may be slow for a while
+    Timeout ATNetworkTimeout() const { return atNetworkTimeout; }
+    void ATNetworkTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); atNetworkTimeout = timeout; }
+    //! Limits of the response timeout derived from the observed latency of each command
+    void ATTimeoutLimits(unsigned minMs, unsigned maxMs) { ASSERT(minMs && minMs <= maxMs); atTimeoutMinMs = minMs; atTimeoutMaxMs = maxMs; }
+    //! Maximum time for establishing a connection
     Timeout ConnectTimeout() const { return connectTimeout; }
     void ConnectTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); connectTimeout = timeout; }
+    //! Maximum time without receiving any data on a connected socket, infinite by default
+    Timeout IdleTimeout() const { return idleTimeout; }
+    void IdleTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); idleTimeout = timeout; }
+    //! Maximum time for which pending output may not be accepted by the modem, infinite by default
+    Timeout SendTimeout() const { return sendTimeout; }
+    void SendTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); sendTimeout = timeout; }
     Timeout DisconnectTimeout() const { return disconnectTimeout; }
     void DisconnectTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); disconnectTimeout = timeout; }
+    //! Idle time after which the modem is put to sleep, keeping the network connection
+    //! Infinite by default, the modem stays awake until powered off
+    //! The polls of reports wake the modem up, but do not restart the idle time
+    Timeout SleepTimeout() const { return sleepTimeout; }
+    void SleepTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); sleepTimeout = timeout; }
+    //! Idle time after which the modem is powered off, counted from the start of sleep if sleep is enabled
     Timeout PowerOffTimeout() const { return powerOffTimeout; }
     void PowerOffTimeout(Timeout timeout) { ASSERT(timeout.IsRelative()); powerOffTimeout = timeout; }
+    //! Delay before reconnecting a persistent socket, doubled after every failed attempt up to the maximum,
+    //! a modem stopped after a failure is started again only when the first socket is due
+    void ReconnectDelay(unsigned minMs, unsigned maxMs) { ASSERT(minMs && minMs <= maxMs); reconnectMinMs = minMs; reconnectMaxMs = maxMs; }
+    //! Interval of querying the data acknowledged by the peer, on modems which report it (SIM800)
+    void AckInterval(Timeout timeout) { ASSERT(timeout.IsRelative()); ackInterval = Ticks(timeout); }
+    //! Time for which resolved host addresses are used for new connections
+    unsigned DnsCacheSeconds() const { return dnsCacheSeconds; }
+    void DnsCacheSeconds(unsigned seconds) { dnsCacheSeconds = seconds; }
 
     async(WaitForIdle, Timeout timeout);
     async(WaitForPowerOn, Timeout timeout);
     async(WaitForPowerOff, Timeout timeout);
-    Socket* CreateSocket(Span host, uint32_t port, bool tls);
+    //! Creates a new socket connecting to the specified host
+    //! Persistent sockets are reconnected when the connection is lost, keeping unsent data
+    //! If the modem reports the data acknowledged by the peer (SIM800), the data of persistent
+    //! sockets is kept until acknowledged and sent again after reconnecting, so the peer may
+    //! receive some of it twice; otherwise (SIM7600) the data is delivered at most once, whatever
+    //! the modem has accepted before the connection was lost is not sent again
+    Socket* CreateSocket(Span host, uint32_t port, bool tls, bool persistent = false);
     Message* SendMessage(Span recipient, Span text);
+    //! Requests the host name to be resolved in advance, so that plain TCP sockets
+    //! created later can connect directly to the cached address
+    //! @returns false if the cache entry cannot be allocated
+    bool Prefetch(Span host);
+    //! Drops all cached host addresses
+    void FlushDnsCache();
 
 protected:
     enum struct ATResult : int8_t
@@ -155,9 +243,23 @@ protected:
     //! Executes a simple AT command
     //! @returns an ATResult indicating the result of the command execution
     async(ATFormatV, const char* format, va_list va);
+    //! Executes a pre-built AT command with arguments
+    //! @returns an ATResult indicating the result of the command execution
+    async(ATCommand, Span prefix, ATArgs args);
+    //! Executes several simple AT commands combined into a single command line
+    //! If the combined line fails, the commands are executed again one by one,
+    //! the individual results are stored in @p results if provided
+    //! @returns the ATResult of the first failed command, or OK if all succeed
+    async(ATBatch, const Span* cmds, size_t count, ATResult* results = NULL);
 
     void ReceiveForSocket(Socket* sock, size_t len) { rxSock = sock; rxLen = len; }
 
+    //! Gets the address to which the socket should connect,
+    //! either the cached address of the host or the host name itself,
+    //! always the host name for TLS sockets; an expired address is still used
+    //! if it could not be resolved again, and a new resolution is requested
+    const char* ConnectAddress(Socket& sock);
+
     async(NetworkActive, Timeout timeout = Timeout::Infinite);
 
     virtual size_t SocketSizeImpl() const { return sizeof(Socket); }
@@ -168,6 +270,11 @@ protected:
     virtual async(ReceivePacketImpl, Socket& sock) = 0;
     virtual async(CheckIncomingImpl, Socket& sock) = 0;
     virtual async(CloseImpl, Socket& sock) = 0;
+    //! Queries the data of the socket acknowledged by the peer, see Socket::PeerAcknowledged
+    virtual async(CheckAcksImpl, Socket& sock) async_def_return(false);
+    //! Resolves the host name of the entry and stores the address in it,
+    //! the entry must not be modified if the resolution fails
+    virtual async(ResolveImpl, DnsEntry& entry) async_def_return(false);
 
     virtual async(SendMessageImpl, Message& msg) async_def_return(false);
 
@@ -177,7 +284,16 @@ protected:
     virtual async(UnlockSimImpl) async_def_return(true);
     virtual async(ConnectNetworkImpl) async_def_return(true);
     virtual async(DisconnectNetworkImpl) async_def_return(true);
+    //! Puts the modem into a low power state which keeps the network registration
+    //! @returns false if sleep is not supported
+    virtual async(SleepImpl) async_def_return(false);
+    //! Wakes the modem from sleep and makes sure it responds to AT commands again
+    virtual async(WakeImpl) async_def_return(true);
     virtual async(StopImpl) async_def_return(true);
+    //! Applies the report settings to the running modem, see LoadReports
+    virtual async(ConfigureReportsImpl) async_def_return(true);
+    //! Queries the current state of a polled report
+    virtual async(PollReportImpl, ModemOptions::Report report) async_def_return(true);
     virtual async(OnEvent, FNV1a id) async_def_return(true);
     virtual void OnTaskStopped() {}
 
@@ -189,6 +305,15 @@ protected:
     void Rssi(int8_t value) { rssi = value; }
 
     void RequestProcessing() { process = true; }
+    //! Reads the report settings from the options and schedules the polled reports,
+    //! the implementation calls it before configuring the reports of the modem
+    void LoadReports();
+
+    //! Marks the start of a phase of the modem start handled by the implementation,
+    //! the previous phase is finished successfully
+    void BootEnter(BootPhase phase) { boots.Enter(phase); }
+    //! Counts a retry in the current phase of the modem start
+    void BootRetry() { boots.Retry(); }
 
     io::PipeReader Input() { return rx; }
     size_t InputLength() const { return rx.LengthUntil(lineEnd); }
@@ -196,6 +321,9 @@ protected:
     ModemOptions& Options() { return options; }
     SelfLinkedList<Socket>& Sockets() { return sockets; }
 
+    //! Calculates the hash identifying a received line from the text before the colon,
+    //! the iterator is left at the colon or after the comma terminating the hashed text
+    static FNV1a HashHeader(io::Pipe::Iterator& iter);
     io::Pipe::Iterator& InputField() { return lineFields; }
     unsigned InputFieldCount() const;
     bool InputFieldNum(int& n, unsigned base = 10);
@@ -203,6 +331,10 @@ protected:
     bool InputFieldFnv(uint32_t& fnv);
 
     void PowerDiagnostic(ModemOptions::CallbackType type, Span msg);
+    //! Gets a buffer for a diagnostic record of at most the specified length,
+    //! DiagnosticDone must follow before any other diagnostic record is started
+    Buffer DiagnosticBuffer(ModemOptions::CallbackType type, size_t len) { return diagnostics.IsEnabled() ? diagnostics.Reserve(type, len) : options.GetDiagnosticBuffer(type); }
+    void DiagnosticDone(ModemOptions::CallbackType type, Buffer data) { if (diagnostics.IsEnabled()) diagnostics.Commit(data.Length()); else options.DiagnosticCallback(type, data); }
 
 private:
     io::PipeReader rx;
@@ -210,6 +342,8 @@ private:
     ModemOptions& options;
     SelfLinkedList<Socket> sockets;
     SelfLinkedList<Message> messages;
+    SelfLinkedList<DnsEntry> dnsCache;
+    TimerWheel<Socket> timers = TimerWheel<Socket>(MonoFromMilliseconds(100));
 
     enum struct Signal
     {
@@ -220,6 +354,8 @@ private:
         NetworkDisconnecting = BIT(3),
         ATLock = BIT(4),
         RequireActive = BIT(5), // set if there are active sockets or messsages
+        Sleeping = BIT(6),
+        ReportsPending = BIT(7), // set when the report settings change or a poll is requested
     } signals = Signal::None;
 
     DECLARE_FLAG_ENUM(Signal);
@@ -229,8 +365,28 @@ private:
     uint8_t atComplete, atRequire;
 
     io::PipePosition lineEnd;
+    mono_t rxLast = 0;
+    mono_t rxBusy = 0, rxBusyFrom;
+    unsigned resyncCount = 0;
     io::Pipe::Iterator lineFields;
     kernel::Task* atTask = NULL;
+    ATStats atStats;
+    ModemCounters counters = {};
+    LinkEstimator uplink;
+    class BootHistory boots;
+    Socket* bootSocket = NULL;
+    ModemOptions::ReportSetting reports[ModemOptions::Reports] = {};
+    mono_t reportPoll[ModemOptions::Reports];
+    uint8_t reportsScheduled = 0;
+    bool reportsChanged = false;
+    TaskPhase phase = TaskPhase::Off;
+    mono_t phaseSince = 0;
+    mono_t atLockSince, atLockCounted;
+    class Trace trace;
+    DiagnosticRing diagnostics;
+    uint32_t atKey;
+    mono_t atStart, atFirstByteAt;
+    bool atFirstByte;
     Timeout atNextTimeout;
     AsyncDelegate<FNV1a> atResponse;
     Socket* atTransmitSock;
@@ -247,20 +403,80 @@ private:
     int8_t rssi = 0;
 
     Timeout atTimeout = Timeout::Seconds(5);
+    Timeout atNetworkTimeout = Timeout::Seconds(10);
+    unsigned atTimeoutMinMs = 500;
+    unsigned atTimeoutMaxMs = 5000;
     Timeout connectTimeout = Timeout::Seconds(30);
+    Timeout idleTimeout = Timeout::Infinite;
+    Timeout sendTimeout = Timeout::Infinite;
     Timeout disconnectTimeout = Timeout::Seconds(10);
+    Timeout sleepTimeout = Timeout::Infinite;
     Timeout powerOffTimeout = Timeout::Infinite;
+    //! Since when there are no sockets and messages, the report polls do not count as activity
+    mono_t idleSince;
+    unsigned dnsCacheSeconds = 600;
+    unsigned reconnectMinMs = 1000;
+    unsigned reconnectMaxMs = 60000;
+    mono_t ackInterval = MonoFromMilliseconds(500);
+
+    enum
+    {
+        DnsCacheSize = 8,
+        //! Space reserved for a formatted command in the diagnostic ring
+        MaxDiagnosticCommand = 128,
+    };
 
     async(Task);
     async(RxTask);
+    async(DiagnosticTask);
     async(ATResponse);
+    //! Realigns commands and responses after a lost response, keeping the session
+    async(Resync);
+
+    void DiagnosticCommand(Span cmd);
+    //! Releases the AT lock
+    void ATRelease();
+    //! Starts timing a command, commands with zero key are not added to the statistics
+    void ATStart(uint32_t key) { atKey = key; atFirstByte = false; counters.commands++; trace.Add(Trace::Category::AT, Trace::Event::Command, key); }
+    //! Marks the start of the response to the pending command, received at the specified time
+    void ATResponding(mono_t at) { if (!atFirstByte) { atFirstByte = true; atFirstByteAt = at; } }
+    Timeout ATAdaptiveTimeout() const;
+    //! Accounts the time spent in the previous phase of the task
+    void EnterPhase(TaskPhase phase);
+    //! Finishes the first connection phase of the start once the socket is connected or fails
+    void CheckBootSocket();
+    //! Checks if the current processing pass can go on with the next operation, it stops
+    //! while received data is pending and after a lost response, until resynchronized
+    bool PassContinues() const { return !rxLen && modemStatus != ModemStatus::CommandError; }
+    //! RxTask brackets its waits with these, so only the processing is accounted as busy
+    void RxWaitBegin() { rxBusy += MONO_CLOCKS - rxBusyFrom; }
+    void RxWaitEnd() { rxBusyFrom = MONO_CLOCKS; }
+    bool ReportDue(unsigned report) const { return (reportsScheduled & BIT(report)) && OVF_DIFF(reportPoll[report], MONO_CLOCKS) <= 0; }
+    //! Gets the timeout of the next socket deadline or report poll
+    Timeout NextWakeup() const;
+    //! Gets the end of the idle period of the specified length starting the specified delay
+    //! after the modem became idle, or the next report poll if it is due earlier
+    Timeout IdleTimeout(mono_t delay, Timeout length) const;
+    bool IdleExpired(mono_t delay, Timeout length) const { return !length.IsInfinite() && OVF_DIFF(idleSince + delay + Ticks(length), MONO_CLOCKS) <= 0; }
+    //! Time after becoming idle when the power off timeout starts, the modem is sleeping by then
+    mono_t PowerOffDelay() const { return sleepTimeout.IsInfinite() ? 0 : Ticks(sleepTimeout); }
 
     void ReleaseSocket(Socket* sock);
     void DestroySocket(Socket* sock);
+    mono_t ReconnectDelay(unsigned attempt) const { return MonoFromMilliseconds(unsigned(std::min(uint64_t(reconnectMinMs) << std::min(attempt, 16u), uint64_t(reconnectMaxMs)))); }
+
+    //! Converts a relative timeout setting to monotonic clock ticks
+    static mono_t Ticks(Timeout timeout) { return timeout.MakeAbsolute().ToMono() - MONO_CLOCKS; }
+    bool SocketDeadline(Socket& sock, mono_t& at);
+    const char* ExpiredDeadline(Socket& sock);
+    void ScheduleDeadline(Socket& sock);
 
     void ReleaseMessage(Message* msg);
     void DestroyMessage(Message* msg);
 
+    DnsEntry* FindDnsEntry(const char* host, size_t len);
+    bool DnsPending() const { for (auto& e: dnsCache) { if (e.resolve) return true; } return false; }
+
     friend class Socket;
     friend class Message;
 };
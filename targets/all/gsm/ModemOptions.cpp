@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ModemOptions.cpp
+ */
+
+#include <gsm/ModemOptions.h>
+
+namespace gsm
+{
+
+async(ModemOptions::DiagnosticRecord, CallbackType type, mono_t time, char* data, size_t length)
+async_def()
+{
+    DiagnosticCallback(type, data, length);
+}
+async_end
+
+}
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <base/base.h>
+#include <kernel/kernel.h>
 
 namespace gsm
 {
@@ -26,6 +27,40 @@ public:
     virtual bool RemovePin() { return true; }
     virtual bool UseFlowControl() { return true; }
 
+    //! Classes of reports about the network, each unsolicited report wakes up the driver
+    enum struct Report : uint8_t
+    {
+        Signal,         //!< signal strength and error rate
+        Registration,   //!< network registration and the location of the serving cell
+        NetworkInfo,    //!< serving cell information (SIM7600 only)
+        Time,           //!< network time and time zone
+    };
+
+    enum
+    {
+        Reports = unsigned(Report::Time) + 1,
+    };
+
+    enum struct ReportMode : uint8_t
+    {
+        Off,            //!< not reported
+        Unsolicited,    //!< reported by the modem, at most once per interval where the modem can limit the rate
+        Polled,         //!< queried by the driver once per interval while it is processing,
+                        //!< only on request (see Modem::PollReport) if the interval is zero
+    };
+
+    struct ReportSetting
+    {
+        ReportMode mode;
+        uint16_t interval;  //!< seconds
+    };
+
+    //! Selects how the driver receives the report, evaluated when the modem starts
+    //! and after Modem::ReconfigureReports
+    //! Registration changes are always reported as the driver depends on them,
+    //! Off and Polled leave out the cell location, Time cannot be polled
+    virtual ReportSetting UseReport(Report report) { return { ReportMode::Unsolicited, uint16_t(report == Report::NetworkInfo ? 10 : 0) }; }
+
     enum struct CallbackType
     {
         CommandSend,
@@ -47,6 +82,12 @@ public:
     virtual RES_PAIR_DECL(GetDiagnosticBuffer, CallbackType type) { return Buffer(); }
     ALWAYS_INLINE void DiagnosticCallback(CallbackType type, Buffer data) { DiagnosticCallback(type, data.Pointer(), data.Length()); }
     virtual void DiagnosticCallback(CallbackType type, char* data, size_t length) { }
+    //! Receives records captured by Modem::CaptureDiagnostics from a separate task,
+    //! a slow consumer (e.g. writing to flash) should await its I/O so the modem keeps running,
+    //! the data remains valid until the operation completes
+    virtual async(DiagnosticRecord, CallbackType type, mono_t time, char* data, size_t length);
+    //! Reports records lost because the capture ring was full
+    virtual void DiagnosticsDropped(size_t count) { }
 };
 
 }
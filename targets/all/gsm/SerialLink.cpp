@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/SerialLink.cpp
+ */
+
+#include <gsm/SerialLink.h>
+
+namespace gsm
+{
+
+async(SerialLink::WaitForStatus, bool on, Timeout timeout)
+async_def(
+    bool on;
+    mono_t until;
+)
+{
+    ASSERT(!timeout.IsInfinite());
+    f.on = on;
+    f.until = timeout.MakeAbsolute().ToMono();
+
+    // there is no event for a generic status input, check it periodically
+    while (IsOn() != f.on)
+    {
+        if (OVF_DIFF(MONO_CLOCKS, f.until) >= 0)
+        {
+            async_return(false);
+        }
+        async_delay_ms(10);
+    }
+
+    async_return(true);
+}
+async_end
+
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/SerialLink.h
+ *
+ * Serial port and control signals of a modem, independent of the platform
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <io/io.h>
+
+#include <gsm/ModemOptions.h>
+
+//! Set when the platform provides the USART and GPIO drivers used by USARTLink
+#ifndef GSM_USART_LINK
+#if __has_include(<hw/USART.h>)
+#define GSM_USART_LINK  1
+#else
+#define GSM_USART_LINK  0
+#endif
+#endif
+
+namespace gsm
+{
+
+class SerialLink
+{
+public:
+    //! Data received from the modem
+    io::Pipe& Rx() { return rx; }
+    //! Data to be transmitted to the modem
+    io::Pipe& Tx() { return tx; }
+
+    //! Starts transferring data between the port and the pipes
+    //! @returns false if the port cannot be used, the receive pipe is closed
+    virtual async(Start) = 0;
+    //! Stops transferring data, the receive pipe is closed,
+    //! does nothing if the link has not been started successfully
+    virtual async(Stop) = 0;
+    //! Changes the serial port settings
+    virtual void Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl) = 0;
+
+    //! Switches the power supply of the modem, if controlled
+    virtual void Power(bool on) { }
+    //! Presses or releases the power key, if controlled
+    virtual void PowerKey(bool pressed) { }
+    //! Gets the status output of the modem, modems without one are always on
+    virtual bool IsOn() { return true; }
+    //! Waits until the status output reaches the specified state
+    virtual async(WaitForStatus, bool on, Timeout timeout);
+    //! Allows the modem to enter slow clock mode, using the DTR signal
+    virtual void AllowSleep(bool allow) { }
+
+protected:
+    io::Pipe rx, tx;
+};
+
+}
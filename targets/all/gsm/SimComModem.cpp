@@ -21,6 +21,27 @@
 namespace gsm
 {
 
+// commands executed for every packet
+static constexpr ATTemplate atCipSend("+CIPSEND=");
+static constexpr ATTemplate atCchSend("+CCHSEND=");
+static constexpr ATTemplate atCchRecv("+CCHRECV=");
+static constexpr ATTemplate atCipClose("+CIPCLOSE=");
+static constexpr ATTemplate atCchClose("+CCHCLOSE=");
+
+void SimComModem::Bind(Socket& sock, uint8_t channel)
+{
+    auto& s = S(sock);
+    s.channel = channel;
+    s.incoming = s.outgoing = s.lastSent = 0;
+    s.sendBase = unsafe_cast<int>(sock.OutputReader().Position());
+    // SIM800 reports the data acknowledged by the peer in +CIPACK, it is polled only
+    // for persistent sockets, the data of the others is not sent again anyway
+    s.peerAcks = model == Model::SIM800 && sock.IsPersistent();
+    s.inFlight = 0;
+    s.error = false;
+    sock.Allocate();
+}
+
 bool SimComModem::TryAllocateImpl(Socket& sock)
 {
     switch (model)
@@ -36,8 +57,7 @@ bool SimComModem::TryAllocateImpl(Socket& sock)
             }
             if (avail)
             {
-                S(sock).channel = __builtin_ctz(avail);
-                sock.Allocate();
+                Bind(sock, __builtin_ctz(avail));
                 MYDBG("%s channel %d bound to socket %p", "TLS/TCP", S(sock).channel, &sock);
                 return true;
             }
@@ -55,8 +75,7 @@ bool SimComModem::TryAllocateImpl(Socket& sock)
             }
             if (avail)
             {
-                S(sock).channel = __builtin_ctz(avail);
-                sock.Allocate();
+                Bind(sock, __builtin_ctz(avail));
                 MYDBG("%s channel %d bound to socket %p", sock.IsSecure() ? "TLS" : "TCP", S(sock).channel, &sock);
                 return true;
             }
@@ -81,7 +100,9 @@ async_def()
             {
                 TcpStatus(TcpStatus::TlsError);
             }
-            else if (await(ATFormat, "+CIPSTART=%d,\"TCP\",\"%s\",\"%d\"", ((SimComSocket&)sock).channel, sock.host, sock.port))
+            else if (await(ATLock) ||
+                NextATTimeout(ATNetworkTimeout()) ||
+                await(ATFormat, "+CIPSTART=%d,\"TCP\",\"%s\",\"%d\"", ((SimComSocket&)sock).channel, ConnectAddress(sock), sock.port))
             {
                 sock.Disconnected();
                 TcpStatus(TcpStatus::ConnectionError);
@@ -96,7 +117,9 @@ async_def()
         case Model::SIM7600:
             if (sock.IsSecure())
             {
-                if (!await(ATFormat, "+CCHOPEN=%d,\"%s\",%d,2", ((SimComSocket&)sock).channel, sock.host, sock.port))
+                if (!(await(ATLock) ||
+                    NextATTimeout(ATNetworkTimeout()) ||
+                    await(ATFormat, "+CCHOPEN=%d,\"%s\",%d,2", ((SimComSocket&)sock).channel, ConnectAddress(sock), sock.port)))
                 {
                     sock.Bound();
                     async_return(true);
@@ -104,7 +127,9 @@ async_def()
             }
             else
             {
-                if (!await(ATFormat, "+CIPOPEN=%d,\"TCP\",\"%s\",%d", ((SimComSocket&)sock).channel, sock.host, sock.port))
+                if (!(await(ATLock) ||
+                    NextATTimeout(ATNetworkTimeout()) ||
+                    await(ATFormat, "+CIPOPEN=%d,\"TCP\",\"%s\",%d", ((SimComSocket&)sock).channel, ConnectAddress(sock), sock.port)))
                 {
                     sock.Bound();
                     async_return(true);
@@ -124,33 +149,11 @@ async_end
 
 async(SimComModem::SendPacketImpl, Socket& sock)
 async_def(
-    SimComModem* self;
-    SimComSocket* sock;
     size_t len;
-    const char* type;
-
-    async(OnReceiveAck, FNV1a header)
-    async_def_sync()
-    {
-        int sent, ack, nak;
-        if (header == "+CIPACK" && self->InputFieldNum(sent) && self->InputFieldNum(ack) && self->InputFieldNum(nak))
-        {
-            int curPos = unsafe_cast<int>(sock->OutputReader().Position());
-            if (curPos != sent)
-            {
-                MYDBG("Recovering after error, advancing %d to %d", sent - curPos, sent);
-                sock->OutputReader().Advance(sent - curPos);
-            }
-            sock->error = false;
-            self->ATComplete(2);
-        }
-    }
-    async_end
+    Span cmd;
 )
 {
-    f.self = this;
-    f.sock = &S(sock);
-    f.len = std::min(size_t(MaxPacket), sock.OutputReader().Available());
+    f.len = std::min(size_t(MaxPacket), sock.OutputReader().Available() - sock.inFlight);
 
     if (!f.len)
     {
@@ -165,14 +168,15 @@ async_def(
     if (model == Model::SIM800 && S(sock).error)
     {
         // check actual ACK status after send failure
-        NextATResponse(GetDelegate(&f, &__FRAME::OnReceiveAck), 3);
+        ackSocket = &S(sock);
+        NextATResponse(GetDelegate(this, &SimComModem::OnReceiveAck), 3);
         if (await(ATFormat, "+CIPACK=%d" , S(sock).channel))
         {
             async_return(false);
         }
 
         // update output length, there may be changes...
-        f.len = std::min(size_t(MaxPacket), sock.OutputReader().Available());
+        f.len = std::min(size_t(MaxPacket), sock.OutputReader().Available() - sock.inFlight);
         if (!f.len)
         {
             async_return(0);
@@ -188,7 +192,7 @@ async_def(
     S(sock).outgoing = S(sock).lastSent = f.len;
     sock.Sending();
     NextATTransmit(sock, f.len);
-    f.type = "IP";
+    f.cmd = atCipSend.Prefix();
     if (model == Model::SIM800)
     {
         // SIM800 sends just DATA ACCEPT or SEND FAIL
@@ -200,10 +204,12 @@ async_def(
         NextATResponse(GetDelegate(this, &SimComModem::OnSendResponse7600), 3);
         if (sock.IsSecure())
         {
-            f.type = "CH";
+            f.cmd = atCchSend.Prefix();
         }
     }
-    auto res = (ATResult)await(ATFormat, "+C%sSEND=%d,%d", f.type, S(sock).channel, f.len);
+    // the final result of SIM7600 arrives only after the data is sent out
+    NextATTimeout(ATNetworkTimeout());
+    auto res = (ATResult)await(ATCommand, f.cmd, ATArgs().Int(S(sock).channel).Int(f.len));
     if (sock.IsSending())
     {
         MYDBG("Sending TIMED OUT for socket %p", &sock);
@@ -214,6 +220,41 @@ async_def(
 }
 async_end
 
+async(SimComModem::CheckAcksImpl, Socket& sock)
+async_def()
+{
+    if (await(ATLock))
+    {
+        async_return(false);
+    }
+
+    ackSocket = &S(sock);
+    NextATResponse(GetDelegate(this, &SimComModem::OnReceiveAck), 3);
+    async_return(!await(ATFormat, "+CIPACK=%d", S(sock).channel));
+}
+async_end
+
+async(SimComModem::OnReceiveAck, FNV1a header)
+async_def_sync()
+{
+    int sent, ack, nak;
+    if (header == "+CIPACK" && InputFieldNum(sent) && InputFieldNum(ack) && InputFieldNum(nak))
+    {
+        // the counters of the modem start with the connection
+        auto s = ackSocket;
+        int curPos = unsafe_cast<int>(s->OutputReader().Position()) - s->sendBase;
+        if (s->error)
+        {
+            MYDBG("Recovering after error, sent %d, acknowledged %d, confirmed so far %d", sent, ack, curPos);
+        }
+        // after an error, the modem may have accepted more than confirmed
+        s->PeerAcknowledged(std::max(ack - curPos, 0), std::max(sent - ack, 0));
+        s->error = false;
+        ATComplete(2);
+    }
+}
+async_end
+
 async(SimComModem::OnSendResponse800, FNV1a header)
 async_def_sync()
 {
@@ -223,7 +264,7 @@ async_def_sync()
         if (InputFieldNum(ch) && InputFieldNum(len))
         {
             // data accepted
-            Socket* s = FindSocket(ch, true);
+            Socket* s = FindTcpSocket(ch);
             if (!s)
             {
                 MYDBG("Send confirmation (%d) for unallocated TCP socket %d", len, ch);
@@ -233,7 +274,7 @@ async_def_sync()
                 MYTRACE("%d bytes accepted for socket %p", len, s);
                 ASSERT((size_t)len == S(s)->outgoing);
                 s->SendingFinished();
-                s->OutputReader().Advance(len);
+                s->Sent(len);
                 S(s)->outgoing = 0;
             }
         }
@@ -242,7 +283,7 @@ async_def_sync()
     else if (header == "SEND FAIL")
     {
         uint8_t ch = Input().Peek(0) - '0';
-        Socket* s = FindSocket(ch, true);
+        Socket* s = FindTcpSocket(ch);
         if (!s)
         {
             MYDBG("Send fail for unallocated TCP socket %d", ch);
@@ -282,7 +323,7 @@ async_def_sync()
                 else
                 {
                     MYTRACE("Packet sent for socket %p", s);
-                    s->OutputReader().Advance(S(s)->outgoing);
+                    s->Sent(S(s)->outgoing);
                 }
 
                 S(s)->outgoing = 0;
@@ -291,6 +332,45 @@ async_def_sync()
         }
         ATComplete(2);
     }
+    else if (header == "+CIPSEND")
+    {
+        int ch, req, cnf;
+        if (InputFieldNum(ch) && InputFieldNum(req) && InputFieldNum(cnf))
+        {
+            // data sent, a negative length means the link is already closed
+            Socket* s = FindTcpSocket(ch);
+            if (!s)
+            {
+                MYDBG("Send confirmation (%d) for unallocated TCP socket %d", cnf, ch);
+            }
+            else
+            {
+                if (cnf < 0)
+                {
+                    MYDBG("Sending failed for socket %p", s);
+                }
+                else
+                {
+                    MYTRACE("%d of %d bytes sent for socket %p", cnf, req, s);
+                    s->Sent(cnf);
+                }
+
+                S(s)->outgoing = 0;
+                s->SendingFinished();
+            }
+        }
+        ATComplete(2);
+    }
+    else if (header == "+CIPERROR")
+    {
+        // the failed send is finished by SendPacketImpl
+        int err;
+        if (InputFieldNum(err))
+        {
+            MYDBG("Sending failed: %d", err);
+        }
+        ATComplete(2);
+    }
 }
 async_end
 
@@ -298,7 +378,7 @@ async(SimComModem::ReceivePacketImpl, Socket& sock)
 async_def()
 {
     sock.IncomingRequested();
-    async_return(!await(ATFormat, "+CCHRECV=%d,%d", S(sock).channel, MaxPacket));
+    async_return(!await(ATCommand, atCchRecv.Prefix(), ATArgs().Int(S(sock).channel).Int(MaxPacket)));
 }
 async_end
 
@@ -316,7 +396,7 @@ async_def()
     switch (model)
     {
         case Model::SIM800:
-            if (!await(ATFormat, "+CIPCLOSE=%d", S(sock).channel))
+            if (!await(ATCommand, atCipClose.Prefix(), ATArgs().Int(S(sock).channel)))
             {
                 async_return(true);
             }
@@ -325,14 +405,14 @@ async_def()
         case Model::SIM7600:
             if (sock.IsSecure())
             {
-                if (!await(ATFormat, "+CCHCLOSE=%d", S(sock).channel))
+                if (!await(ATCommand, atCchClose.Prefix(), ATArgs().Int(S(sock).channel)))
                 {
                     async_return(true);
                 }
             }
             else
             {
-                if (!await(ATFormat, "+CIPCLOSE=%d", S(sock).channel))
+                if (!await(ATCommand, atCipClose.Prefix(), ATArgs().Int(S(sock).channel)))
                 {
                     async_return(true);
                 }
@@ -347,41 +427,128 @@ async_def()
 }
 async_end
 
+async(SimComModem::ResolveImpl, DnsEntry& entry)
+async_def(
+    SimComModem* self;
+    bool resolved;
+    // the entry keeps its previous address until the lookup succeeds
+    char address[sizeof(DnsEntry::address)];
+
+    async(OnResolveResponse, FNV1a header)
+    async_def_sync()
+    {
+        if (header == "+CDNSGIP")
+        {
+            int success;
+            uint32_t tmp;
+            if (self->InputFieldNum(success) && success && self->InputFieldFnv(tmp))    // skip host name
+            {
+                // first address, without quotes
+                size_t n = 0;
+                bool overflow = false;
+                for (char c: self->InputField())
+                {
+                    if (c == ',')
+                    {
+                        break;
+                    }
+                    if (c == '"')
+                    {
+                        continue;
+                    }
+                    if (n == sizeof(address) - 1)
+                    {
+                        overflow = true;
+                        break;
+                    }
+                    address[n++] = c;
+                }
+                address[n] = 0;
+                resolved = n && !overflow;
+            }
+            // SIM7600 sends the result before OK, SIM800 after it
+            self->ATComplete(2);
+        }
+    }
+    async_end
+)
+{
+    if (model == Model::Unknown)
+    {
+        async_return(false);
+    }
+
+    f.self = this;
+    f.resolved = false;
+
+    if (await(ATLock) ||
+        NextATTimeout(ConnectTimeout()) ||
+        NextATResponse(GetDelegate(&f, &__FRAME::OnResolveResponse), 3) ||
+        await(ATFormat, "+CDNSGIP=\"%s\"", entry.Host()) ||
+        !f.resolved)
+    {
+        async_return(false);
+    }
+
+    memcpy(entry.address, f.address, sizeof(entry.address));
+    async_return(true);
+}
+async_end
+
 async(SimComModem::PowerOnImpl)
 async_def()
 {
-    powerEnable.Set();
+    serial.Power(true);
 
-    if (status)
+    warm = serial.IsOn();
+    if (warm)
     {
+        // most likely after a reset of the MCU, the modem may still be connected
         MYDBG("Already powered on.");
     }
     else
     {
         // power on
         MYDBG("Powering on...");
-        powerButton.Res();
-        bool success = await(status.WaitFor, true, Timeout::Seconds(20));
-        powerButton.Set();
+        serial.PowerKey(true);
+        bool success = await(serial.WaitForStatus, true, Timeout::Seconds(20));
+        serial.PowerKey(false);
         if (!success)
         {
             MYDBG("Power on failed...");
-            powerEnable.Res();
+            serial.Power(false);
             async_return(false);
         }
         MYDBG("Powered on.");
     }
 
-    dtr.Set();
+    if (warm)
+    {
+        // the modem may have been left sleeping, keep it awake until reconfigured
+        serial.AllowSleep(false);
+    }
+    else
+    {
+        serial.AllowSleep(true);
+    }
     async_delay_ms(50);
 
-    gsmRx.Reset();
-    gsmTx.Reset();
+    serial.Rx().Reset();
+    serial.Tx().Reset();
+#if GSM_WIRE_CAPTURE
+    wire.Reset();
+#endif
+
+    if (!await(serial.Start))
+    {
+        MYDBG("Serial port failed to start");
+        serial.Power(false);
+        async_return(false);
+    }
 
-    await_multiple_init();
-    await_multiple_add(usartRx, &io::USARTRxPipe::Start);
-    await_multiple_add(usartTx, &io::USARTTxPipe::Start);
-    await_multiple();
+#if GSM_WIRE_CAPTURE
+    wire.Start();
+#endif
 
     async_return(true);
 }
@@ -421,6 +588,54 @@ async_def()
 }
 async_end
 
+async(SimComModem::SleepImpl)
+async_def()
+{
+    // slow clock mode 1, the modem sleeps while DTR is high
+    if (await(AT, "+CSCLK=1"))
+    {
+        async_return(false);
+    }
+
+    serial.AllowSleep(true);
+    async_return(true);
+}
+async_end
+
+async(SimComModem::WakeImpl)
+async_def(
+    unsigned i;
+)
+{
+    MYDBG("Waking up...");
+    serial.AllowSleep(false);
+    async_delay_ms(50);     // the UART is active 50 ms after DTR goes low
+
+    // the first characters may be lost while the modem is waking up,
+    // so make sure it responds before sending anything important
+    for (f.i = 0; f.i < 5; f.i++)
+    {
+        if (!(await(ATLock) ||
+            NextATTimeout(Timeout::Milliseconds(100)) ||
+            await(AT, Span())))
+        {
+            break;
+        }
+        // a lost probe is expected here, not a broken command sequence
+        ModemStatus(ModemStatus::Ok);
+        BootRetry();
+    }
+
+    if (f.i == 5 || await(AT, "+CSCLK=0"))
+    {
+        async_return(false);
+    }
+
+    serial.AllowSleep(true);
+    async_return(true);
+}
+async_end
+
 async(SimComModem::PowerOffImpl)
 async_def()
 {
@@ -438,48 +653,136 @@ async_def()
 
     Output().Close();
 
-    await_multiple_init();
-    await_multiple_add(usartRx, &io::USARTRxPipe::Stop, Timeout::Infinite);
-    await_multiple_add(usartTx, &io::USARTTxPipe::Stop, Timeout::Infinite);
-    await_multiple();
+    await(serial.Stop);
 
     // power off
     MYDBG("Powering off...");
-    powerEnable.Res();
+    serial.Power(false);
     async_delay_ms(100);
 }
 async_end
 
 async(SimComModem::StartImpl)
 async_def(
-    unsigned i;
+    LinkProfile profile;
+    uint8_t candidate;
 )
 {
+    if (LoadLinkProfile(f.profile))
+    {
+        MYDBG("Trying stored link settings, %d baud", f.profile.baudRate);
+        ConfigureLink(f.profile);
+        if (await(Probe, 3))
+        {
+            link = f.profile;
+            async_return(await(Initialize, true));
+        }
+    }
+
     MYDBG("Autobauding...");
 
-    usartRx.GetUSART().BaudRate(115200);
-    usartRx.GetUSART().FlowControlDisable();
-    usartRx.GetUSART().FrameSetup(USART::FrameBits8 | USART::ParityNone | USART::StopBitsOne);
+    link = { uint8_t(Model::Unknown), uint8_t(ModemOptions::Parity::Off), false, 115200 };
+    ConfigureLink(link);
+
+    if (await(Probe, 10))
+    {
+        async_return(await(Initialize, false));
+    }
 
-    for (f.i = 0; f.i < 10; f.i++)
+    // the stored profile may have been lost while the modem still uses the fast settings saved by &W
+    for (f.candidate = uint8_t(Model::SIM800); f.candidate <= uint8_t(Model::SIM7600); f.candidate++)
+    {
+        f.profile = { uint8_t(Model::Unknown), uint8_t(LinkParity()), Options().UseFlowControl(), ModelBaudRate(Model(f.candidate)) };
+        MYDBG("Trying %d baud with saved settings", f.profile.baudRate);
+        ConfigureLink(f.profile);
+        if (await(Probe, 3))
+        {
+            link = f.profile;
+            async_return(await(Initialize, false));
+        }
+    }
+
+    MYDBG("Autobauding failed");
+    ModemStatus(ModemStatus::AutoBaudFailure);
+    async_return(false);
+}
+async_end
+
+async(SimComModem::Probe, unsigned attempts)
+async_def(
+    unsigned i;
+)
+{
+    for (f.i = 0; f.i < attempts; f.i++)
     {
         if (!(await(ATLock) ||
             NextATTimeout(Timeout::Milliseconds(100)) ||
             await(AT, Span())))
         {
-            async_return(await(Initialize));
+            async_return(true);
         }
+        // a lost probe is expected here, not a broken command sequence
+        ModemStatus(ModemStatus::Ok);
     }
 
-    MYDBG("Autobauding failed");
-    ModemStatus(ModemStatus::AutoBaudFailure);
     async_return(false);
 }
 async_end
 
-async(SimComModem::Initialize)
+void SimComModem::ConfigureLink(const LinkProfile& profile)
+{
+    serial.Configure(profile.baudRate, ModemOptions::Parity(profile.parity), profile.flowControl);
+}
+
+ModemOptions::Parity SimComModem::LinkParity()
+{
+    auto parity = Options().UseParity();
+    return parity == ModemOptions::Parity::Even || parity == ModemOptions::Parity::Odd ? parity : ModemOptions::Parity::Off;
+}
+
+bool SimComModem::LoadLinkProfile(LinkProfile& profile)
+{
+    Span stored = nvram::Get(ID("GSMl"));
+    if (stored.Length() != LinkProfile::StoredSize)
+    {
+        return false;
+    }
+
+    auto p = (const uint8_t*)stored.Pointer();
+    profile.model = p[0];
+    profile.parity = p[1];
+    profile.flowControl = p[2];
+    profile.baudRate = p[3] | p[4] << 8 | p[5] << 16 | uint32_t(p[6]) << 24;
+    if (profile.model == uint8_t(Model::Unknown) || profile.model > uint8_t(Model::SIM7600))
+    {
+        return false;
+    }
+
+    // use the stored profile only if it matches the current options
+    return profile.flowControl == Options().UseFlowControl() && profile.parity == uint8_t(LinkParity());
+}
+
+void SimComModem::SaveLinkProfile(const LinkProfile& profile)
+{
+    LinkProfile stored;
+    if (LoadLinkProfile(stored) && stored == profile)
+    {
+        return;
+    }
+
+    MYDBG("Storing link settings");
+    uint8_t data[LinkProfile::StoredSize] = {
+        profile.model, profile.parity, profile.flowControl,
+        uint8_t(profile.baudRate), uint8_t(profile.baudRate >> 8), uint8_t(profile.baudRate >> 16), uint8_t(profile.baudRate >> 24),
+    };
+    nvram::Add(ID("GSMl"), data, sizeof(data));
+}
+
+async(SimComModem::Initialize, bool restored)
 async_def(
     ModemOptions::Parity parity;
+    Span batch[8];
+    size_t n;
 )
 {
     model = Model::Unknown;
@@ -493,76 +796,108 @@ async_def(
         async_return(false);
     }
 
-    // request modem identification
-    if (await(ATLock) ||
-        NextATResponse(GetDelegate(this, &SimComModem::OnReceiveId)) ||
-        await(AT, "I"))
+    if (warm)
     {
-        async_return(false);
+        // sleep may have been enabled before the restart
+        if (await(AT, "+CSCLK=0"))
+        {
+            async_return(false);
+        }
+        serial.AllowSleep(true);
     }
 
-    if (model == Model::Unknown)
+    if (restored)
     {
-        MYDBG("Failed to determine model");
-        async_return(false);
+        // the link has been configured and saved in the modem before,
+        // identification and serial port setup can be skipped
+        model = Model(link.model);
+        MYDBG("%s restored", ModelName());
     }
     else
     {
-        MYDBG("%s detected", ModelName());
-    }
+        // request modem identification
+        if (await(ATLock) ||
+            NextATResponse(GetDelegate(this, &SimComModem::OnReceiveId)) ||
+            await(AT, "I"))
+        {
+            async_return(false);
+        }
 
-    if (Options().UseFlowControl())
-    {
-        MYDBG("Enabling handshaking");
-        if (!await(ATFormat, "+IFC=2,2"))
+        if (model == Model::Unknown)
         {
-            usartRx.GetUSART().FlowControlEnable();
+            MYDBG("Failed to determine model");
+            async_return(false);
+        }
+        else
+        {
+            MYDBG("%s detected", ModelName());
         }
-    }
 
-    f.parity = Options().UseParity();
-    if (f.parity == ModemOptions::Parity::Even || f.parity == ModemOptions::Parity::Odd)
-    {
-        MYDBG("Enabling %s parity", f.parity == ModemOptions::Parity::Even ? "EVEN" : "ODD");
-        if (!await(ATFormat, "+ICF=2,%d", f.parity == ModemOptions::Parity::Even))
+        link.model = uint8_t(model);
+
+        if (Options().UseFlowControl())
+        {
+            MYDBG("Enabling handshaking");
+            if (!await(ATFormat, "+IFC=2,2"))
+            {
+                link.flowControl = true;
+                ConfigureLink(link);
+            }
+        }
+
+        f.parity = Options().UseParity();
+        if (f.parity == ModemOptions::Parity::Even || f.parity == ModemOptions::Parity::Odd)
+        {
+            MYDBG("Enabling %s parity", f.parity == ModemOptions::Parity::Even ? "EVEN" : "ODD");
+            if (!await(ATFormat, "+ICF=2,%d", f.parity == ModemOptions::Parity::Even))
+            {
+                async_delay_ms(100);         // must wait, communicating too quickly confuses the module
+                link.parity = uint8_t(f.parity);
+                ConfigureLink(link);
+            }
+        }
+
+        MYDBG("Switching to %d baud", ModelBaudRate());
+        if (!await(ATFormat, "+IPR=%d", ModelBaudRate()))
         {
             async_delay_ms(100);         // must wait, communicating too quickly confuses the module
-            usartRx.GetUSART().FrameSetup(USART::FrameBits8 | (f.parity == ModemOptions::Parity::Even ? USART::ParityEven : USART::ParityOdd) | USART::StopBitsOne);
+            link.baudRate = ModelBaudRate();
+            ConfigureLink(link);
+        }
+
+        if (model == Model::SIM800)
+        {
+            // additional identification
+            if (await(ATLock) ||
+                NextATResponse(GetDelegate(this, &SimComModem::OnReceiveId)) ||
+                await(AT, "+GSV"))    // additional identification
+            {
+                async_return(false);
+            }
+        }
+
+        // save the port settings in the modem, so they apply right after the next power on
+        if (!await(AT, "&W"))
+        {
+            SaveLinkProfile(link);
         }
     }
 
-    MYDBG("Switching to %d baud", ModelBaudRate());
-    if (!await(ATFormat, "+IPR=%d", ModelBaudRate()))
+    // configuration commands are sent in a single command line
+    f.n = 0;
+    f.batch[f.n++] = "+CMEE=2";         // extended error reporting
+    if (model == Model::SIM800)
     {
-        async_delay_ms(100);         // must wait, communicating too quickly confuses the module
-        usartRx.GetUSART().BaudRate(ModelBaudRate());
+        f.batch[f.n++] = "+CSDT=0";     // SIM card detection off
     }
-
     if (model == Model::SIM800)
     {
-        // additional identification
-        if (await(ATLock) ||
-            NextATResponse(GetDelegate(this, &SimComModem::OnReceiveId)) ||
-            await(AT, "+GSV"))    // additional identification
-        {
-            async_return(false);
-        }
+        f.batch[f.n++] = "+CR=1";       // network info
     }
+    LoadReports();
+    f.n += ReportCommands(f.batch + f.n);
 
-    if (await(AT, "+CMEE=2") ||     // extended error reporting
-        (model == Model::SIM800 && await(AT, "+CSDT=0")) ||     // SIM card detection off
-        await(AT, "+CREG=2") ||     // extended network registration notifications
-        await(AT, "+CGREG=2") ||    // extended GPRS network registration notifications
-        // network timestamp notifications
-        (model == Model::SIM800 && await(AT, "+CLTS=1")) ||
-        (model == Model::SIM7600 && await(AT, "+CTZR=1")) ||
-        // signal strength and error rate
-        (model == Model::SIM800 && await(AT, "+EXUNSOL=\"SQ\",1")) ||
-        (model == Model::SIM7600 && await(AT, "+AUTOCSQ=1,1")) ||
-        // network info
-        (model == Model::SIM800 && await(AT, "+CR=1")) ||
-        (model == Model::SIM7600 && await(AT, "+CPSI=10")) ||
-        false)
+    if (await(ATBatch, f.batch, f.n))
     {
         async_return(false);
     }
@@ -570,6 +905,11 @@ async_def(
     if (model == Model::SIM800)
     {
         // wait for CFUN to be nonzero to avoid unnecessary SIM errors
+        if (warm)
+        {
+            // the +CFUN event has been sent long ago
+            await(AT, "+CFUN?");
+        }
         await_mask_not_sec(cfun, 0xFF, 0, 5);
     }
 
@@ -577,6 +917,72 @@ async_def(
 }
 async_end
 
+size_t SimComModem::ReportCommands(Span* batch)
+{
+    using Report = ModemOptions::Report;
+    using Mode = ModemOptions::ReportMode;
+    size_t n = 0;
+
+    // registration changes are needed by the driver, only the location is optional
+    bool location = ReportSetting(Report::Registration).mode == Mode::Unsolicited;
+    batch[n++] = location ? "+CREG=2" : "+CREG=1";      // network registration notifications
+    batch[n++] = location ? "+CGREG=2" : "+CGREG=1";    // GPRS network registration notifications
+
+    bool time = ReportSetting(Report::Time).mode == Mode::Unsolicited;
+    bool signal = ReportSetting(Report::Signal).mode == Mode::Unsolicited;
+    if (model == Model::SIM800)
+    {
+        batch[n++] = time ? "+CLTS=1" : "+CLTS=0";                              // network timestamp notifications
+        batch[n++] = signal ? "+EXUNSOL=\"SQ\",1" : "+EXUNSOL=\"SQ\",0";        // signal strength and error rate
+    }
+    else
+    {
+        batch[n++] = time ? "+CTZR=1" : "+CTZR=0";                              // network timestamp notifications
+        batch[n++] = signal ? "+AUTOCSQ=1,1" : "+AUTOCSQ=0,0";                  // signal strength and error rate, on change
+
+        // network info, at the requested interval
+        auto info = ReportSetting(Report::NetworkInfo);
+        unsigned interval = info.mode != Mode::Unsolicited ? 0 : info.interval ? std::min(info.interval, uint16_t(255)) : 10;
+        auto res = Buffer(cpsiCmd, sizeof(cpsiCmd)).Format("+CPSI=%u", interval);
+        batch[n++] = Span(cpsiCmd, res.end() - cpsiCmd);
+    }
+
+    return n;
+}
+
+async(SimComModem::ConfigureReportsImpl)
+async_def(
+    Span batch[5];
+    size_t n;
+)
+{
+    f.n = ReportCommands(f.batch);
+    async_return(!await(ATBatch, f.batch, f.n));
+}
+async_end
+
+async(SimComModem::PollReportImpl, ModemOptions::Report report)
+async_def()
+{
+    // the responses are handled by OnEvent the same as the unsolicited reports
+    if (report == ModemOptions::Report::Signal)
+    {
+        async_return(!await(AT, "+CSQ"));
+    }
+    else if (report == ModemOptions::Report::Registration)
+    {
+        static const Span query[] = { "+CREG?", "+CGREG?" };
+        async_return(!await(ATBatch, query, sizeof(query) / sizeof(query[0])));
+    }
+    else if (report == ModemOptions::Report::NetworkInfo && model != Model::SIM800)
+    {
+        async_return(!await(AT, "+CPSI?"));
+    }
+
+    async_return(true);
+}
+async_end
+
 async(SimComModem::OnReceiveId, FNV1a header)
 async_def_sync()
 {
@@ -655,9 +1061,19 @@ async_def(
         {
             async_return(false);
         }
+        BootRetry();
 
-        // try again in a while
-        async_delay_ms(1000);
+        // try again in a while, or as soon as the SIM reports ready,
+        // a ready report seen before (e.g. followed by SIM busy) does not shorten the delay
+        if (sim.ready)
+        {
+            async_delay_sec(1);
+        }
+        else
+        {
+            async_delay_ms(100);
+            await_signal_sec(sim.ready, 1);
+        }
     }
 
     {
@@ -707,14 +1123,22 @@ async_def(
     Timeout timeout;
 )
 {
-    if (await(AT, "+CREG?") ||
-        await(AT, "+CGREG?") ||
-        await(AT, "+COPS?") ||
-        await(AT, "+CSQ"))
+    // the PDP context does not depend on registration, it is set up while the network is being searched
+    // (a warm modem has been configured already, see StartGprs)
+    if (!warm && !await(ConfigureGprs))
     {
+        TcpStatus(TcpStatus::GprsError);
         async_return(false);
     }
 
+    {
+        static const Span query[] = { "+CREG?", "+CGREG?", "+COPS?", "+CSQ" };
+        if (await(ATBatch, query, sizeof(query) / sizeof(query[0])))
+        {
+            async_return(false);
+        }
+    }
+
     MYDBG("Waiting for network...");
     if (!await_signal_sec(net.active, 120))
     {
@@ -723,6 +1147,7 @@ async_def(
     }
 
     MYDBG("Waiting for GPRS...");
+    BootEnter(BootPhase::Gprs);
     if (!await(StartGprs))
     {
         TcpStatus(TcpStatus::GprsError);
@@ -734,7 +1159,9 @@ async_def(
 async_end
 
 async(SimComModem::StartGprs)
-async_def()
+async_def(
+    bool adopted;
+)
 {
     if (!await_signal_sec(gprs.active, 5))
     {
@@ -748,35 +1175,39 @@ async_def()
 
     gprs.attached = true;
 
-    MYDBG("Connecting GPRS...");
-    if (model == Model::SIM800)
+    // the connection established before a reset of the MCU can be used as it is
+    f.adopted = warm && await(AdoptGprs);
+    if (f.adopted)
     {
-        // enable socket multiplexing
-        if (await(AT, "+CIPMUX=1") || await(AT, "+CIPQSEND=1"))
+        MYDBG("Reusing active GPRS connection");
+    }
+    else
+    {
+        if (warm && !await(ConfigureGprs))
         {
             async_return(false);
         }
-    }
 
-    // define PDP context
-    MYDBG("Connecting to APN: %b", Options().GetApn());
-    if (await(ATFormat, "+CGDCONT=1,\"IP\",\"%b\"", Options().GetApn()))
-    {
-        async_return(false);
-    }
+        MYDBG("Connecting GPRS...");
 
-    // activate PDP context
-    if (await(ATLock) ||
-        NextATTimeout(Timeout::Seconds(60)) ||
-        await(AT, "+CGACT=1,1"))
-    {
-        async_return(false);
+        // activate PDP context
+        if (await(ATLock) ||
+            NextATTimeout(Timeout::Seconds(60)) ||
+            await(AT, "+CGACT=1,1"))
+        {
+            async_return(false);
+        }
     }
 
     gprs.pdpActive = true;
 
     if (model == Model::SIM800)
     {
+        if (f.adopted)
+        {
+            async_return(true);
+        }
+
         // start the data transfer task
         if (await(ATFormat, "+CSTT=\"%b\",\"%b\",\"%b\"", Options().GetApn(), Options().GetApnUser(), Options().GetApnPassword()))
         {
@@ -800,23 +1231,21 @@ async_def()
     }
     else
     {
-        // configure GPRS auth
-        if (Options().GetApnUser().Length() || Options().GetApnPassword().Length())
+        if (!f.adopted)
         {
-            if (await(ATFormat, "+CGAUTH=1,3,\"%b\",\"%b\"", Options().GetApnUser(), Options().GetApnPassword()))
+            // activate TCP
+            if (await(ATLock) ||
+                NextATTimeout(Timeout::Seconds(60)) ||
+                NextATResponse(GetDelegate(this, &SimComModem::OnReceiveNetCch), 3) ||
+                await(AT, "+NETOPEN") ||
+                net.error)
             {
                 async_return(false);
             }
         }
 
-        // activate TCP and TLS
+        // activate TLS
         if (await(ATLock) ||
-            NextATTimeout(Timeout::Seconds(60)) ||
-            NextATResponse(GetDelegate(this, &SimComModem::OnReceiveNetCch), 3) ||
-            await(AT, "+NETOPEN") ||
-            net.error ||
-            await(AT, "+CCHSET=1,0") ||
-            await(ATLock) ||
             NextATResponse(GetDelegate(this, &SimComModem::OnReceiveNetCch), 3) ||
             await(AT, "+CCHSTART") ||
             net.error)
@@ -835,6 +1264,204 @@ async_def()
 }
 async_end
 
+async(SimComModem::ConfigureGprs)
+async_def()
+{
+    if (model == Model::SIM800)
+    {
+        // enable socket multiplexing
+        static const Span mux[] = { "+CIPMUX=1", "+CIPQSEND=1" };
+        if (await(ATBatch, mux, sizeof(mux) / sizeof(mux[0])))
+        {
+            async_return(false);
+        }
+    }
+
+    // define PDP context
+    MYDBG("Using APN: %b", Options().GetApn());
+    if (await(ATFormat, "+CGDCONT=1,\"IP\",\"%b\"", Options().GetApn()))
+    {
+        async_return(false);
+    }
+
+    if (model == Model::SIM7600)
+    {
+        // configure GPRS auth
+        if (Options().GetApnUser().Length() || Options().GetApnPassword().Length())
+        {
+            if (await(ATFormat, "+CGAUTH=1,3,\"%b\",\"%b\"", Options().GetApnUser(), Options().GetApnPassword()))
+            {
+                async_return(false);
+            }
+        }
+
+        // report the result of every TLS send with +CCHSEND
+        if (await(AT, "+CCHSET=1,0"))
+        {
+            async_return(false);
+        }
+    }
+
+    async_return(true);
+}
+async_end
+
+async(SimComModem::AdoptGprs)
+async_def(
+    SimComModem* self;
+    uint32_t state;
+    uint16_t open;
+    unsigned ch;
+    bool mux, pdp, netOpen;
+
+    async(OnStateResponse, FNV1a header)
+    async_def_sync()
+    {
+        int n;
+        uint32_t tmp;
+        switch (header)
+        {
+            case fnv1a("+CIPMUX"):
+                mux = self->InputFieldNum(n) && n == 1;
+                break;
+
+            case fnv1a("STATE"):
+                // arrives after OK, the connection list follows in multi-connection mode
+                self->InputFieldFnv(state);
+                if (!mux)
+                {
+                    self->ATComplete(2);
+                }
+                break;
+
+            case fnv1a("C"):
+                // C: <n>,<bearer>,<TCP/UDP>,<address>,<port>,<state>
+                if (self->InputFieldNum(n))
+                {
+                    for (unsigned i = 0; i < 5; i++)
+                    {
+                        self->InputFieldFnv(tmp);
+                    }
+                    if (tmp == fnv1a("\"CONNECTED\"") || tmp == fnv1a("\"CONNECTING\"") || tmp == fnv1a("\"REMOTE CLOSING\""))
+                    {
+                        open |= BIT(n);
+                    }
+                    if (n == 5)
+                    {
+                        self->ATComplete(2);
+                    }
+                }
+                break;
+
+            case fnv1a("+CGACT"):
+                if (self->InputFieldNum(n) && n == 1 && self->InputFieldNum(n))
+                {
+                    pdp = n == 1;
+                }
+                break;
+
+            case fnv1a("+NETOPEN"):
+                netOpen = self->InputFieldNum(n) && n == 1;
+                break;
+
+            case fnv1a("+CIPCLOSE"):
+                // link states of all channels
+                for (unsigned i = 0; self->InputFieldNum(n); i++)
+                {
+                    if (n)
+                    {
+                        open |= BIT(i);
+                    }
+                }
+                break;
+        }
+    }
+    async_end
+)
+{
+    f.self = this;
+
+    if (model == Model::SIM800)
+    {
+        if (await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnStateResponse)) ||
+            await(AT, "+CIPMUX?") ||
+            await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnStateResponse), 3) ||
+            await(AT, "+CIPSTATUS"))
+        {
+            async_return(false);
+        }
+
+        if (!f.mux || (f.state != fnv1a("IP STATUS") && f.state != fnv1a("IP PROCESSING")))
+        {
+            if (f.state != fnv1a("IP INITIAL"))
+            {
+                // the connection cannot be used, start over
+                MYDBG("Resetting incomplete GPRS connection");
+                await(ATLock) ||
+                    NextATResponse(GetDelegate(this, &SimComModem::OnReceiveShutOK), 2) ||
+                    await(AT, "+CIPSHUT");
+            }
+            async_return(false);
+        }
+    }
+    else
+    {
+        if (await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnStateResponse)) ||
+            await(AT, "+CGACT?") ||
+            await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnStateResponse)) ||
+            await(AT, "+NETOPEN?"))
+        {
+            async_return(false);
+        }
+
+        if (!f.pdp || !f.netOpen)
+        {
+            if (f.netOpen)
+            {
+                await(ATLock) ||
+                    NextATResponse(GetDelegate(this, &SimComModem::OnReceiveNetCch), 3) ||
+                    await(AT, "+NETCLOSE");
+            }
+            if (f.pdp)
+            {
+                MYDBG("Resetting incomplete GPRS connection");
+                await(AT, "+CGACT=0,1");
+            }
+            async_return(false);
+        }
+
+        if (await(ATLock) ||
+            NextATResponse(GetDelegate(&f, &__FRAME::OnStateResponse)) ||
+            await(AT, "+CIPCLOSE?"))
+        {
+            async_return(false);
+        }
+
+        // stopping the TLS service closes all its sessions, it is started again right away
+        await(ATLock) ||
+            NextATResponse(GetDelegate(this, &SimComModem::OnReceiveNetCch), 3) ||
+            await(AT, "+CCHSTOP");
+    }
+
+    // close connections left over from before the restart
+    for (f.ch = 0; f.open; f.ch++)
+    {
+        if (f.open & BIT(f.ch))
+        {
+            f.open &= ~BIT(f.ch);
+            MYDBG("Closing orphaned channel %d", f.ch);
+            await(ATCommand, atCipClose.Prefix(), ATArgs().Int(f.ch));
+        }
+    }
+
+    async_return(true);
+}
+async_end
+
 async(SimComModem::OnEvent, FNV1a hash)
 async_def_sync()
 {
@@ -933,10 +1560,38 @@ async_def_sync()
             async_return(true);
         }
 
+        case fnv1a("+CIPOPEN"):
+        {
+            int ch, status;
+            if (InputFieldNum(ch) && InputFieldNum(status))
+            {
+                Socket* s = FindTcpSocket(ch);
+                if (!s)
+                {
+                    MYDBG("Status arrived for unallocated TCP socket %d", ch);
+                }
+                else
+                {
+                    if (!status)
+                    {
+                        MYDBG("%p connected", s);
+                        s->Connected();
+                    }
+                    else
+                    {
+                        MYDBG("%p connection failed: %d", s, status);
+                        s->Disconnected();
+                    }
+                    RequestProcessing();
+                }
+            }
+            async_return(true);
+        }
+
         case fnv1a("CONNECT OK"):
         {
             uint8_t ch = Input().Peek(0) - '0';
-            Socket* s = FindSocket(ch, true);
+            Socket* s = FindTcpSocket(ch);
             if (!s)
             {
                 MYDBG("Status arrived for unallocated TCP socket %d", ch);
@@ -971,6 +1626,34 @@ async_def_sync()
             async_return(true);
         }
 
+        case fnv1a("+CIPCLOSE"):
+            if (InputFieldCount() != 2)
+            {
+                // link states in response to +CIPCLOSE?
+                async_return(false);
+            }
+            // fall through
+
+        case fnv1a("+IPCLOSE"):
+        {
+            int ch;
+            if (InputFieldNum(ch))
+            {
+                Socket* s = FindTcpSocket(ch);
+                if (!s)
+                {
+                    MYDBG("Status arrived for unallocated TCP socket %d", ch);
+                }
+                else
+                {
+                    MYDBG("%p disconnected", s);
+                    s->Disconnected();
+                    RequestProcessing();
+                }
+            }
+            async_return(true);
+        }
+
         case fnv1a("CLOSE OK"):
             ATComplete();   // this event arrives instead of OK
             // fall through
@@ -978,7 +1661,7 @@ async_def_sync()
         case fnv1a("CLOSED"):
         {
             uint8_t ch = Input().Peek(0) - '0';
-            Socket* s = FindSocket(ch, true);
+            Socket* s = FindTcpSocket(ch);
             if (!s)
             {
                 MYDBG("Status arrived for unallocated TCP socket %d", ch);
@@ -1070,7 +1753,7 @@ async_def_sync()
             if (InputFieldNum(ch) && InputFieldNum(len), len)    // InputFieldNum(len) will return an error, since the length is followed by a colon
             {
                 // data received for channel
-                Socket* s = FindSocket(ch, true);
+                Socket* s = FindTcpSocket(ch);
                 if (!s)
                 {
                     MYDBG("Incoming %d bytes of data for unallocated TCP socket %d", len, ch);
@@ -1191,12 +1874,9 @@ async_def(
     async_end
 )
 {
-    if (await(AT, "+CMGF=1"))
-    {
-        async_return(false);
-    }
-
-    if (await(ATLock))
+    if (await(ATLock) ||
+        await(AT, "+CMGF=1") ||
+        await(ATLock))
     {
         async_return(false);
     }
@@ -1207,6 +1887,8 @@ async_def(
     msg.Sending();
     NextATTransmit(msg);
     NextATResponse(GetDelegate(&f, &__FRAME::OnSendMessageResponse), 3);
+    // the network may take tens of seconds to accept the message
+    NextATTimeout(Timeout::Seconds(60));
     auto res = (ATResult)await(ATFormat, "+CMGS=\"%b\"", msg.Recipient());
     if (msg.IsSending())
     {
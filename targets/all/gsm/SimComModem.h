@@ -13,15 +13,12 @@
 
 #include <kernel/kernel.h>
 
-#include <hw/GPIO.h>
-#include <hw/USART.h>
-
-#include <io/USARTRxPipe.h>
-#include <io/USARTTxPipe.h>
-
 #include <nvram/nvram.h>
 
 #include <gsm/Modem.h>
+#include <gsm/SerialLink.h>
+#include <gsm/USARTLink.h>
+#include <gsm/WireCapture.h>
 
 namespace gsm
 {
@@ -32,19 +29,29 @@ private:
     struct SimComSocket : Socket
     {
         size_t incoming, outgoing, lastSent;
+        int sendBase;   //!< output position at which the current connection started
         bool error;
         uint8_t channel;
     };
 
     SimComSocket* FindSocket(uint8_t channel) { for (auto& s: Sockets()) { if (s.IsAllocated() && S(s).channel == channel) return S(&s); } return NULL; }
     SimComSocket* FindSocket(uint8_t channel, bool secure) { for (auto& s: Sockets()) { if (s.IsAllocated() && s.IsSecure() == secure && S(s).channel == channel) return (SimComSocket*)&s; } return NULL; }
+    //! Finds the socket of a channel reported by the TCP commands, SIM800 uses them for TLS sockets too
+    SimComSocket* FindTcpSocket(uint8_t channel) { return model == Model::SIM800 ? FindSocket(channel) : FindSocket(channel, false); }
 
     SimComSocket& S(Socket& sock) { return (SimComSocket&)sock; }
     SimComSocket* S(Socket* sock) { return (SimComSocket*)sock; }
 
+    //! Binds the socket to a channel, resetting the per-connection state
+    //! (persistent sockets are bound again after reconnecting)
+    void Bind(Socket& sock, uint8_t channel);
+
 public:
-    SimComModem(ModemOptions& options, USART& usart, GPIOPin powerEnable, GPIOPin powerButton, GPIOPin status, GPIOPin dtr)
-        : Modem(io::DuplexPipe(gsmRx, gsmTx), options), usartRx(usart, gsmRx), usartTx(usart, gsmTx), powerEnable(powerEnable), powerButton(powerButton), status(status), dtr(dtr)
+    //! Creates the driver for a modem connected over the specified link,
+    //! e.g. USARTLink on the MCU
+    SimComModem(ModemOptions& options, SerialLink& serial)
+        : Modem(io::DuplexPipe(GsmRx(serial), GsmTx(serial)), options),
+        serial(serial)
     {
     }
 
@@ -60,6 +67,11 @@ public:
 
     Model DetectedModel() const { return model; }
 
+#if GSM_WIRE_CAPTURE
+    //! Gets the capture of the raw serial link
+    WireCapture& Wire() { return wire; }
+#endif
+
 protected:
     virtual size_t SocketSizeImpl() const final override { return sizeof(SimComSocket); }
     virtual bool TryAllocateImpl(Socket& sock) final override;
@@ -68,9 +80,13 @@ protected:
     virtual async(ReceivePacketImpl, Socket& sock) final override;
     virtual async(CheckIncomingImpl, Socket& sock) final override;
     virtual async(CloseImpl, Socket& sock) final override;
+    virtual async(CheckAcksImpl, Socket& sock) final override;
+    virtual async(ResolveImpl, DnsEntry& entry) final override;
 
     virtual async(SendMessageImpl, Message& msg) final override;
 
+    async(OnEvent, FNV1a id) override;
+
 private:
     enum struct Registration
     {
@@ -85,15 +101,41 @@ private:
     static const char* StatusName(Registration reg) { return STRINGS("NONE", "HOME", "SEARCHING", "DENIED", "UNKNOWN", "ROAMING")[int(reg)]; }
 
     const char* ModelName() const { return STRINGS(NULL, "SIM800", "SIM7600")[int(model)]; }
-    unsigned ModelBaudRate() const { return LOOKUP_TABLE(unsigned, 115200, 460800, 3200000)[int(model)]; }
-
-    io::Pipe gsmRx, gsmTx;
-    io::USARTRxPipe usartRx;
-    io::USARTTxPipe usartTx;
-    GPIOPin powerEnable, powerButton, status, dtr;
+    static unsigned ModelBaudRate(Model model) { return LOOKUP_TABLE(unsigned, 115200, 460800, 3200000)[int(model)]; }
+    unsigned ModelBaudRate() const { return ModelBaudRate(model); }
+
+    SerialLink& serial;
+#if GSM_WIRE_CAPTURE
+    io::Pipe gsmRx, gsmTx;  // driver side of the capture
+    WireCapture wire = WireCapture(serial.Rx(), serial.Tx(), gsmRx, gsmTx);
+    io::Pipe& GsmRx(SerialLink& serial) { return gsmRx; }
+    io::Pipe& GsmTx(SerialLink& serial) { return gsmTx; }
+#else
+    // the driver uses the pipes of the link directly
+    io::Pipe& GsmRx(SerialLink& serial) { return serial.Rx(); }
+    io::Pipe& GsmTx(SerialLink& serial) { return serial.Tx(); }
+#endif
     bool removePin = false;
+    //! The modem was already powered on when starting, its connection is reused if possible
+    bool warm = false;
+
+    //! Serial link configuration, stored in nvram after successful detection
+    //! (serialized field by field, see LoadLinkProfile)
+    struct LinkProfile
+    {
+        enum { StoredSize = 7 };
+
+        uint8_t model;
+        uint8_t parity;
+        bool flowControl;
+        uint32_t baudRate;
+
+        bool operator ==(const LinkProfile& other) const { return model == other.model && parity == other.parity && flowControl == other.flowControl && baudRate == other.baudRate; }
+        bool operator !=(const LinkProfile& other) const { return !(*this == other); }
+    };
 
     Model model = Model::Unknown;
+    LinkProfile link;
     uint8_t cfun;
     struct
     {
@@ -118,7 +160,9 @@ private:
     } gprs = {};
 
     char pin[9] = {0};
+    char cpsiCmd[12];   //!< +CPSI command with the reporting interval
 
+    SimComSocket* ackSocket;    //!< socket queried by +CIPACK
     Timeout allocateTimeout = Timeout::Seconds(1);
     bool running = false;
 
@@ -128,12 +172,28 @@ private:
     async(UnlockSimImpl) override;
     async(ConnectNetworkImpl) override;
     async(DisconnectNetworkImpl) override;
-
-    async(Initialize);
+    async(SleepImpl) override;
+    async(WakeImpl) override;
+    async(ConfigureReportsImpl) override;
+    async(PollReportImpl, ModemOptions::Report report) override;
+
+    //! Adds the commands configuring the reports according to the settings to the batch
+    //! @returns the number of commands added
+    size_t ReportCommands(Span* batch);
+
+    async(Initialize, bool restored);
+    async(Probe, unsigned attempts);
+
+    void ConfigureLink(const LinkProfile& profile);
+    //! Parity of the link as requested by the options, or Off if not supported
+    ModemOptions::Parity LinkParity();
+    bool LoadLinkProfile(LinkProfile& profile);
+    void SaveLinkProfile(const LinkProfile& profile);
+    async(ConfigureGprs);
     async(StartGprs);
+    async(AdoptGprs);
 
-    async(OnEvent, FNV1a id) override;
-
+    async(OnReceiveAck, FNV1a header);
     async(OnSendResponse800, FNV1a header);
     async(OnSendResponse7600, FNV1a header);
 
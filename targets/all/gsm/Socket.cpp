@@ -25,6 +25,11 @@ async_def_once()
 {
     Output().Close();
     flags |= SocketFlags::AppClose;
+    if (IsReconnecting())
+    {
+        // no channel is held while backing off, there is nothing to close
+        Finished();
+    }
     owner->RequestProcessing();
     async_return(await_mask_not_timeout(flags, SocketFlags::ModemClosed, 0, timeout));
 }
@@ -35,4 +40,69 @@ void Socket::Release()
     owner->ReleaseSocket(this);
 }
 
+void Socket::Lost()
+{
+    if (!CanReconnect())
+    {
+        Finished();
+        return;
+    }
+
+    // keep both pipes open, unacknowledged data remains in the output pipe and is sent
+    // again, the channel is released so that any free one can be used next time
+    inFlight = 0;
+    reconnectAt = MONO_CLOCKS + owner->ReconnectDelay(retries);
+    owner->counters.reconnects++;
+    if (retries < 255)
+    {
+        retries++;
+    }
+    flags = (flags & (SocketFlags::AppSecure | SocketFlags::AppReference | SocketFlags::AppPersistent)) | SocketFlags::ModemReconnect;
+    owner->RequestProcessing();
+}
+
+void Socket::Acknowledged(size_t len)
+{
+    OutputReader().Advance(len);
+    counters.acked += len;
+    owner->counters.acked += len;
+}
+
+void Socket::Sent(size_t len)
+{
+    // the confirmation of the modem only means the data is in its buffer,
+    // it says nothing about the network
+    if (!peerAcks)
+    {
+        Acknowledged(len);
+        return;
+    }
+
+    if (!inFlight)
+    {
+        ackWait = sendStart;
+        ackCheckAt = MONO_CLOCKS + owner->ackInterval;
+    }
+    inFlight += len;
+}
+
+void Socket::PeerAcknowledged(size_t acked, size_t unacked)
+{
+    if (acked)
+    {
+        if (inFlight)
+        {
+            // the progress since the previous one, or since the data was sent,
+            // data accepted despite a failed send is not timed
+            mono_t now = MONO_CLOCKS;
+            uplink.Sample(acked, now - ackWait);
+            owner->uplink.Sample(acked, now - ackWait);
+            ackWait = now;
+        }
+        Acknowledged(acked);
+    }
+    inFlight = std::min(unacked, OutputReader().Available());
+    ackCheckAt = MONO_CLOCKS + owner->ackInterval;
+}
+
 }
@@ -15,9 +15,14 @@
 #include <io/PipeReader.h>
 #include <io/PipeWriter.h>
 
+#include "Counters.h"
+#include "LinkEstimator.h"
+
 namespace gsm
 {
 
+template<typename T> class TimerWheel;
+
 enum struct SocketFlags : uint16_t
 {
     //! TLS requested for socket
@@ -26,9 +31,13 @@ enum struct SocketFlags : uint16_t
     AppClose = 0x02,
     //! Socket has a reference from the application
     AppReference = 0x04,
+    //! The connection is reestablished when lost, keeping the data not acknowledged yet
+    AppPersistent = 0x08,
 
     //! Check if data is incoming
     CheckIncoming = 0x10,
+    //! The connection has been lost and is waiting to be reestablished
+    ModemReconnect = 0x20,
 
     //! The socket has a modem channel allocated
     ModemAllocated = 0x100,
@@ -65,7 +74,18 @@ public:
 
     bool IsConnected() const { return (flags & (SocketFlags::ModemConnected | SocketFlags::ModemClosed)) == SocketFlags::ModemConnected; }
     bool IsSecure() const { return !!(flags & SocketFlags::AppSecure); }
+    bool IsPersistent() const { return !!(flags & SocketFlags::AppPersistent); }
+    bool IsReconnecting() const { return !!(flags & SocketFlags::ModemReconnect); }
     bool IsClosed() const { return !!(flags & SocketFlags::ModemClosed); }
+    //! Number of consecutive failed connection attempts of a persistent socket
+    unsigned Retries() const { return retries; }
+    //! Data transferred since the socket was created, including all its connections
+    const SocketCounters& Counters() const { return counters; }
+    //! Estimated uplink throughput and acknowledgment time of the socket,
+    //! e.g. for sizing the writes, kept across reconnections
+    //! Only persistent sockets of modems reporting the acknowledgments of the peer provide it
+    //! (SIM800), the time is measured when they are polled, see Modem::AckInterval
+    const LinkEstimator& Uplink() const { return uplink; }
 
     io::PipeReader Input() { return rx; }
     io::PipeWriter Output() { return tx; }
@@ -78,17 +98,46 @@ private:
     io::Pipe rx, tx;
     SocketFlags flags;
     uint16_t port;
+    uint8_t retries = 0;
     const char* host;
+    mono_t reconnectAt;
+    SocketCounters counters = {};
+    LinkEstimator uplink;
+    mono_t sendStart;
+    //! Data passed to the modem and kept in the output until the peer acknowledges it,
+    //! only if the modem reports the acknowledgments (see peerAcks)
+    size_t inFlight = 0;
+    //! Since when the acknowledgment of the data in flight is awaited
+    mono_t ackWait;
+    mono_t ackCheckAt;
+    bool peerAcks = false;
+
+    // deadline tracking
+    mono_t connectStart, lastRx, lastTx;
+    int txPos = 0;
+    bool expired = false;
+
+    // timer wheel linkage
+    Socket* wheelNext;
+    mono_t wheelAt;
+    uint8_t wheelSlot;
+    bool wheelScheduled = false;
 
     io::PipeReader OutputReader() { return tx; }
     io::PipeWriter InputWriter() { return rx; }
 
     bool IsNew() const
     {
-        return (flags & ~SocketFlags::AppSecure)
+        return (flags & ~(SocketFlags::AppSecure | SocketFlags::AppPersistent))
             == SocketFlags::AppReference;
     }
 
+    bool CanReconnect() const
+    {
+        return (flags & (SocketFlags::AppPersistent | SocketFlags::AppReference | SocketFlags::AppClose))
+            == (SocketFlags::AppPersistent | SocketFlags::AppReference);
+    }
+
     bool NeedsClose() const
     {
         return (flags & (SocketFlags::AppClose | SocketFlags::ModemReference | SocketFlags::ModemClosing))
@@ -97,13 +146,18 @@ private:
 
     bool NeedsConnect() const
     {
-        return (flags & (SocketFlags::AppClose | SocketFlags::AppReference | SocketFlags::ModemAllocated | SocketFlags::ModemReference | SocketFlags::ModemConnecting | SocketFlags::ModemClosing | SocketFlags::ModemClosed))
+        return (flags & (SocketFlags::AppClose | SocketFlags::AppReference | SocketFlags::ModemReconnect | SocketFlags::ModemAllocated | SocketFlags::ModemReference | SocketFlags::ModemConnecting | SocketFlags::ModemClosing | SocketFlags::ModemClosed))
             == (SocketFlags::ModemAllocated | SocketFlags::AppReference);
     }
 
     bool DataToSend()
     {
-        return IsConnected() && CanSend() && OutputReader().Available();
+        return IsConnected() && CanSend() && OutputReader().Available() > inFlight;
+    }
+
+    bool AcksToCheck() const
+    {
+        return inFlight && CanSend() && OVF_DIFF(ackCheckAt, MONO_CLOCKS) <= 0;
     }
 
     bool DataToReceive()
@@ -143,6 +197,11 @@ private:
         return !!(flags & SocketFlags::ModemAllocated);
     }
 
+    bool IsConnecting() const
+    {
+        return (flags & (SocketFlags::ModemConnecting | SocketFlags::ModemClosing | SocketFlags::ModemClosed)) == SocketFlags::ModemConnecting;
+    }
+
     void Allocate()
     {
         ASSERT(!IsAllocated());
@@ -159,6 +218,7 @@ private:
     {
         ASSERT(IsAllocated());
         flags = (flags & ~SocketFlags::ModemConnecting) | SocketFlags::ModemConnected;
+        retries = 0;
     }
 
     void Incoming()
@@ -183,6 +243,7 @@ private:
     {
         ASSERT(IsConnected() && CanSend());
         flags |= SocketFlags::ModemSending;
+        sendStart = MONO_CLOCKS;
     }
 
     void SendingFinished()
@@ -194,7 +255,27 @@ private:
     void Disconnected()
     {
         ASSERT(IsAllocated());
-        Finished();
+        Lost();
+    }
+
+    //! The connection has been lost, persistent sockets will be reconnected
+    //! after a delay, the rest are finished
+    void Lost();
+
+    //! The data has been delivered, it is removed from the output
+    void Acknowledged(size_t len);
+    //! The modem has accepted the packet passed to it since Sending(), the data
+    //! is acknowledged, unless the modem reports the acknowledgments of the peer
+    void Sent(size_t len);
+    //! The modem has reported the data acknowledged by the peer since the last report
+    //! and the data it still holds, the acknowledged data is added to the uplink estimates,
+    //! the next report is requested after AckInterval
+    void PeerAcknowledged(size_t acked, size_t unacked);
+
+    void ReconnectNow()
+    {
+        ASSERT(IsReconnecting());
+        flags &= ~SocketFlags::ModemReconnect;
     }
 
     void Finished()
@@ -207,6 +288,7 @@ private:
     friend class Modem;
     friend class SimComModem;
     friend class SelfLinkedList<Socket>;
+    template<typename T> friend class TimerWheel;
 };
 
 }
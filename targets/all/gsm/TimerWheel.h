@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/TimerWheel.h
+ *
+ * Hashed timing wheel for deadlines of intrusively linked elements
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+namespace gsm
+{
+
+//! Elements must provide the wheelNext, wheelAt, wheelSlot and wheelScheduled fields
+//! Timers are allowed to fire early, the owner is expected to check the actual
+//! deadline and schedule the element again
+template<typename T> class TimerWheel
+{
+public:
+    enum
+    {
+        Slots = 32,
+    };
+
+    constexpr TimerWheel(mono_t tick)
+        : tick(tick) {}
+
+    bool IsScheduled(const T& e) const { return e.wheelScheduled; }
+    bool IsEmpty() const { return !count; }
+
+    void Schedule(T& e, mono_t at)
+    {
+        if (e.wheelScheduled)
+        {
+            Cancel(e);
+        }
+
+        if (!count)
+        {
+            cursor = MONO_CLOCKS;
+        }
+
+        // round up, so that the element is due when its slot is reached,
+        // only differences are used, as the clock wraps around
+        auto diff = OVF_DIFF(at, cursor);
+        mono_t steps = diff <= 0 ? 1 : (mono_t(diff) + tick - 1) / tick;
+
+        e.wheelAt = at;
+        e.wheelSlot = (slot + steps) % Slots;
+        e.wheelNext = slots[e.wheelSlot];
+        e.wheelScheduled = true;
+        slots[e.wheelSlot] = &e;
+        count++;
+    }
+
+    void Cancel(T& e)
+    {
+        if (!e.wheelScheduled)
+        {
+            return;
+        }
+
+        for (T** pp = &slots[e.wheelSlot]; *pp; pp = &(*pp)->wheelNext)
+        {
+            if (*pp == &e)
+            {
+                *pp = e.wheelNext;
+                break;
+            }
+        }
+        e.wheelNext = NULL;
+        e.wheelScheduled = false;
+        count--;
+    }
+
+    //! Removes all elements that are due, returns them linked through wheelNext
+    T* Expire(mono_t now)
+    {
+        T* expired = NULL;
+        auto diff = OVF_DIFF(now, cursor);
+        if (!count || diff < 0 || mono_t(diff) < tick)
+        {
+            return NULL;
+        }
+
+        mono_t steps = mono_t(diff) / tick;
+        for (mono_t i = 1; i <= std::min(steps, mono_t(Slots)); i++)
+        {
+            for (T** pp = &slots[(slot + i) % Slots]; *pp;)
+            {
+                T* e = *pp;
+                if (OVF_DIFF(e->wheelAt, now) <= 0)
+                {
+                    *pp = e->wheelNext;
+                    e->wheelScheduled = false;
+                    e->wheelNext = expired;
+                    expired = e;
+                    count--;
+                }
+                else
+                {
+                    // due in one of the next rounds
+                    pp = &e->wheelNext;
+                }
+            }
+        }
+
+        cursor += steps * tick;
+        slot = (slot + steps) % Slots;
+        return expired;
+    }
+
+    //! Gets the timeout after which Expire should be called again
+    Timeout Next() const
+    {
+        mono_t time;
+        return NextTime(time) ? Timeout::Absolute(time) : Timeout::Infinite;
+    }
+
+    //! Gets the time at which Expire should be called again
+    //! @returns false if nothing is scheduled
+    bool NextTime(mono_t& time) const
+    {
+        if (count)
+        {
+            for (unsigned i = 1; i <= Slots; i++)
+            {
+                if (slots[(slot + i) % Slots])
+                {
+                    time = cursor + i * tick;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    mono_t tick;
+    //! Time the current slot was reached, advanced by whole ticks
+    mono_t cursor = 0;
+    unsigned slot = 0;
+    unsigned count = 0;
+    T* slots[Slots] = {};
+};
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/Trace.cpp
+ */
+
+#include <gsm/Trace.h>
+
+#define MYDBG(...)  DBGCL("gsm", __VA_ARGS__)
+
+namespace gsm
+{
+
+bool Trace::Read(uint32_t& pos, Record& rec, uint32_t& dropped) const
+{
+    if (head - pos > Records)
+    {
+        // the reader is too slow, oldest records have been overwritten
+        dropped += head - pos - Records;
+        pos = head - Records;
+    }
+
+    if (pos == head)
+    {
+        return false;
+    }
+
+    rec = ring[pos % Records];
+    pos++;
+    return true;
+}
+
+async(Trace::Drain)
+async_def(
+    uint32_t pos, dropped;
+    Record rec;
+)
+{
+    f.pos = head;
+    for (;;)
+    {
+        await_mask_not(head, ~0u, f.pos);
+
+        while (Read(f.pos, f.rec, f.dropped))
+        {
+            auto& r = f.rec;
+            switch (r.event)
+            {
+                case Event::Command:
+                    MYDBG("%u >> %08X", r.time, r.arg32);
+                    break;
+                case Event::Result:
+                    MYDBG("%u .. %s in %d ms", r.time, STRINGS("OK", "ERROR", "TIMEOUT", "FAILURE")[r.arg8 & 3], r.arg32);
+                    break;
+                case Event::Line:
+                    MYDBG("%u << %08X (%d)", r.time, r.arg32, r.arg16);
+                    break;
+                case Event::Transmit:
+                    MYDBG("%u [%08X] >> %d", r.time, r.arg32, r.arg16);
+                    break;
+                case Event::Receive:
+                    MYDBG("%u [%08X] << %d", r.time, r.arg32, r.arg16);
+                    break;
+                case Event::Segment:
+                    MYDBG("%u [%08X] <<< %d", r.time, r.arg32, r.arg16);
+                    break;
+                case Event::Resync:
+                    MYDBG("%u resync %d %s", r.time, r.arg32, r.arg8 ? "OK" : "FAILED");
+                    break;
+            }
+
+            if (f.dropped)
+            {
+                MYDBG("%d trace records dropped", f.dropped);
+                f.dropped = 0;
+            }
+
+            // formatting is not urgent, let everyone else run
+            async_yield();
+        }
+    }
+}
+async_end
+
+}
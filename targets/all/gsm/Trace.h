@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/Trace.h
+ *
+ * Binary trace of modem activity, recorded into a RAM ring and formatted later
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+#ifndef GSM_TRACE_RECORDS
+#define GSM_TRACE_RECORDS   64
+#endif
+
+namespace gsm
+{
+
+class Trace
+{
+public:
+    enum struct Category : uint8_t
+    {
+        None = 0,
+        AT = BIT(0),        //!< commands and final results
+        Events = BIT(1),    //!< received lines
+        Sockets = BIT(2),   //!< socket transfers
+        Data = BIT(3),      //!< individual data segments
+        All = 0xFF,
+    };
+
+    DECLARE_FLAG_ENUM(Category);
+
+    enum struct Event : uint8_t
+    {
+        Command,    //!< AT command sent - command key
+        Result,     //!< final result - latency [ms], ATResult
+        Line,       //!< line received - header hash, length
+        Transmit,   //!< data sent after the prompt - socket, length
+        Receive,    //!< data received for a socket - socket, length
+        Segment,    //!< data segment moved to a socket - socket, length
+        Resync,     //!< AT channel resynchronization - attempt, success
+    };
+
+    struct Record
+    {
+        uint32_t time;      //!< lower bits of the monotonic clock
+        Event event;
+        uint8_t arg8;
+        uint16_t arg16;
+        uint32_t arg32;
+    };
+
+    enum
+    {
+        Records = GSM_TRACE_RECORDS,
+    };
+
+    static_assert(!(Records & (Records - 1)), "GSM_TRACE_RECORDS must be a power of two");
+
+    //! Selects the categories which are recorded
+    void Enable(Category mask) { this->mask = mask; }
+    Category Enabled() const { return mask; }
+    bool IsEnabled(Category cat) const { return !!(mask & cat); }
+
+    //! Records an event, if its category is enabled
+    void Add(Category cat, Event event, uint32_t arg32, uint16_t arg16 = 0, uint8_t arg8 = 0)
+    {
+        if (IsEnabled(cat))
+        {
+            auto& r = ring[head % Records];
+            r.time = MONO_CLOCKS;
+            r.event = event;
+            r.arg8 = arg8;
+            r.arg16 = arg16;
+            r.arg32 = arg32;
+            head++;
+        }
+    }
+
+    //! Position after the last recorded event
+    uint32_t Head() const { return head; }
+    //! Reads the record at the specified position and advances it
+    //! Records that have been overwritten already are skipped and counted in @p dropped
+    bool Read(uint32_t& pos, Record& rec, uint32_t& dropped) const;
+
+    //! Formats the records to the debug output as they arrive
+    async(Drain);
+
+private:
+    Record ring[Records];
+    uint32_t head = 0;
+    Category mask = Category::AT | Category::Sockets;
+};
+
+DEFINE_FLAG_ENUM(Trace::Category);
+
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/USARTLink.cpp
+ */
+
+#include <gsm/USARTLink.h>
+
+#if GSM_USART_LINK
+
+namespace gsm
+{
+
+async(USARTLink::Start)
+async_def()
+{
+    await_multiple_init();
+    await_multiple_add(usartRx, &io::USARTRxPipe::Start);
+    await_multiple_add(usartTx, &io::USARTTxPipe::Start);
+    await_multiple();
+    async_return(true);
+}
+async_end
+
+async(USARTLink::Stop)
+async_def()
+{
+    await_multiple_init();
+    await_multiple_add(usartRx, &io::USARTRxPipe::Stop, Timeout::Infinite);
+    await_multiple_add(usartTx, &io::USARTTxPipe::Stop, Timeout::Infinite);
+    await_multiple();
+}
+async_end
+
+void USARTLink::Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl)
+{
+    auto& usart = usartRx.GetUSART();
+    usart.BaudRate(baudRate);
+    if (flowControl)
+    {
+        usart.FlowControlEnable();
+    }
+    else
+    {
+        usart.FlowControlDisable();
+    }
+    usart.FrameSetup(USART::FrameBits8 |
+        (parity == ModemOptions::Parity::Even ? USART::ParityEven :
+        parity == ModemOptions::Parity::Odd ? USART::ParityOdd :
+        USART::ParityNone) | USART::StopBitsOne);
+}
+
+async(USARTLink::WaitForStatus, bool on, Timeout timeout)
+async_def()
+{
+    async_return(await(status.WaitFor, on, timeout));
+}
+async_end
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/USARTLink.h
+ *
+ * Modem connected to an USART, with the control signals on GPIO pins
+ */
+
+#pragma once
+
+#include <gsm/SerialLink.h>
+
+#if GSM_USART_LINK
+
+#include <hw/GPIO.h>
+#include <hw/USART.h>
+
+#include <io/USARTRxPipe.h>
+#include <io/USARTTxPipe.h>
+
+namespace gsm
+{
+
+class USARTLink : public SerialLink
+{
+public:
+    USARTLink(USART& usart, GPIOPin powerEnable, GPIOPin powerButton, GPIOPin status, GPIOPin dtr)
+        : usartRx(usart, rx), usartTx(usart, tx), powerEnable(powerEnable), powerButton(powerButton), status(status), dtr(dtr) {}
+
+    virtual async(Start) final override;
+    virtual async(Stop) final override;
+    virtual void Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl) final override;
+
+    // the power button is active low
+    virtual void Power(bool on) final override { if (on) powerEnable.Set(); else powerEnable.Res(); }
+    virtual void PowerKey(bool pressed) final override { if (pressed) powerButton.Res(); else powerButton.Set(); }
+    virtual bool IsOn() final override { return !!status; }
+    virtual async(WaitForStatus, bool on, Timeout timeout) final override;
+    // the modem sleeps while DTR is high
+    virtual void AllowSleep(bool allow) final override { if (allow) dtr.Set(); else dtr.Res(); }
+
+private:
+    io::USARTRxPipe usartRx;
+    io::USARTTxPipe usartTx;
+    GPIOPin powerEnable, powerButton, status, dtr;
+};
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/WireCapture.cpp
+ */
+
+#include <gsm/WireCapture.h>
+
+#define MYDBG(...)  DBGCL("wire", __VA_ARGS__)
+
+namespace gsm
+{
+
+constexpr char WireFormat::Magic[4];
+
+size_t WireFormat::PutVarint(uint8_t* buf, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        buf[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    buf[n++] = value;
+    return n;
+}
+
+size_t WireFormat::GetVarint(Span data, uint32_t& value)
+{
+    auto p = (const uint8_t*)data.Pointer();
+    value = 0;
+    for (size_t i = 0; i < data.Length() && i < 5; i++)
+    {
+        value |= uint32_t(p[i] & 0x7F) << (i * 7);
+        if (!(p[i] & 0x80))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void WireCapture::Capture(io::Pipe& sink)
+{
+    ASSERT(!this->sink);
+    this->sink = &sink;
+    headerPending = true;
+    capturing = true;
+}
+
+void WireCapture::Reset()
+{
+    ASSERT(!IsRunning());
+    rx.Reset();
+    tx.Reset();
+}
+
+void WireCapture::Start()
+{
+    ASSERT(!IsRunning());
+    active = RxActive | TxActive;
+    kernel::Task::Run(this, &WireCapture::RxTask);
+    kernel::Task::Run(this, &WireCapture::TxTask);
+}
+
+async(WireCapture::Record, WireFormat::Tag tag, Span data)
+async_def(
+    uint8_t buf[sizeof(WireFormat::Header)];
+    Span data;
+    size_t len;
+)
+{
+    static_assert(sizeof(WireFormat::Header) >= WireFormat::MaxRecordHeader, "record header does not fit");
+
+    f.data = data;
+    // the directions are recorded by separate tasks, records must not interleave
+    await_mask(sinkBusy, 1, 0);
+    sinkBusy = 1;
+
+    if (!capturing)
+    {
+        if (sink)
+        {
+            io::PipeWriter(*sink).Close();
+            sink = NULL;
+        }
+        sinkBusy = 0;
+        async_return(false);
+    }
+
+    if (headerPending)
+    {
+        headerPending = false;
+        last = MONO_CLOCKS;
+
+        auto& hdr = *(WireFormat::Header*)f.buf;
+        memcpy(hdr.magic, WireFormat::Magic, sizeof(hdr.magic));
+        hdr.version = WireFormat::Version;
+        memset(hdr.reserved, 0, sizeof(hdr.reserved));
+        hdr.frequency = MonoFromSeconds(1);
+        await(io::PipeWriter(*sink).Write, Span(f.buf, sizeof(hdr)));
+    }
+
+    {
+        mono_t now = MONO_CLOCKS;
+        f.buf[0] = uint8_t(tag);
+        f.len = 1 + WireFormat::PutVarint(f.buf + 1, now - last);
+        f.len += WireFormat::PutVarint(f.buf + f.len, f.data.Length());
+        last = now;
+    }
+
+    await(io::PipeWriter(*sink).Write, Span(f.buf, f.len));
+    if (f.data.Length())
+    {
+        await(io::PipeWriter(*sink).Write, f.data);
+    }
+
+    sinkBusy = 0;
+    async_return(true);
+}
+async_end
+
+async(WireCapture::RxTask)
+async_def(
+    size_t len;
+)
+{
+    if (sink)
+    {
+        await(Record, WireFormat::Tag::Start, Span());
+    }
+
+    while (await(phyRx.Require))
+    {
+        f.len = phyRx.GetSpan().Length();
+        if (sink)
+        {
+            await(Record, WireFormat::Tag::Rx, phyRx.GetSpan().Left(f.len));
+        }
+        await(phyRx.MoveTo, io::PipeWriter(rx), f.len);
+    }
+
+    io::PipeWriter(rx).Close();
+    MYDBG("RX Stopped");
+    active &= ~RxActive;
+}
+async_end
+
+async(WireCapture::TxTask)
+async_def(
+    size_t len;
+)
+{
+    while (await(io::PipeReader(tx).Require))
+    {
+        f.len = io::PipeReader(tx).GetSpan().Length();
+        if (sink)
+        {
+            await(Record, WireFormat::Tag::Tx, io::PipeReader(tx).GetSpan().Left(f.len));
+        }
+        await(io::PipeReader(tx).MoveTo, phyTx, f.len);
+    }
+
+    phyTx.Close();
+    MYDBG("TX Stopped");
+    active &= ~TxActive;
+}
+async_end
+
+async(WireReplay::Run, Pace pace)
+async_def(
+    Pace pace;
+    uint32_t frequency;
+    uint32_t delay, len;
+    size_t data;
+    WireFormat::Tag tag;
+)
+{
+    f.pace = pace;
+    pos = mismatch = 0;
+
+    {
+        auto hdr = (const WireFormat::Header*)capture.Pointer();
+        if (capture.Length() < sizeof(WireFormat::Header) ||
+            memcmp(hdr->magic, WireFormat::Magic, sizeof(hdr->magic)) ||
+            hdr->version != WireFormat::Version || !hdr->frequency)
+        {
+            MYDBG("!! Invalid capture header");
+            async_return(false);
+        }
+        f.frequency = hdr->frequency;
+        pos = sizeof(WireFormat::Header);
+    }
+
+    while (pos < capture.Length())
+    {
+        {
+            Span rec = capture.RemoveLeft(pos);
+            size_t n1 = WireFormat::GetVarint(rec.RemoveLeft(1), f.delay);
+            size_t n2 = n1 ? WireFormat::GetVarint(rec.RemoveLeft(1 + n1), f.len) : 0;
+            if (!n2 || rec.Length() - 1 - n1 - n2 < f.len)
+            {
+                MYDBG("!! Truncated record at %d", pos);
+                async_return(false);
+            }
+            f.tag = WireFormat::Tag(rec.Pointer()[0]);
+            f.data = pos + 1 + n1 + n2;
+        }
+
+        if (f.pace == Pace::Recorded && f.delay)
+        {
+            async_delay_ms(uint64_t(f.delay) * 1000 / f.frequency);
+        }
+
+        switch (f.tag)
+        {
+            case WireFormat::Tag::Start:
+                break;
+
+            case WireFormat::Tag::Rx:
+                if (await(output.Write, capture.RemoveLeft(f.data).Left(f.len)) != (int)f.len)
+                {
+                    MYDBG("!! Driver input closed at %d", pos);
+                    async_return(false);
+                }
+                break;
+
+            case WireFormat::Tag::Tx:
+                if (!await(input.Require, f.len))
+                {
+                    MYDBG("!! Driver output closed at %d", pos);
+                    async_return(false);
+                }
+
+                for (size_t i = 0; i < f.len; i++)
+                {
+                    if (input.Peek(i) != capture.Pointer()[f.data + i])
+                    {
+                        mismatch = i;
+                        MYDBG("!! Transmitted data mismatch at %d+%d", pos, i);
+                        async_return(false);
+                    }
+                }
+                input.Advance(f.len);
+                break;
+
+            default:
+                MYDBG("!! Unknown record %02X at %d", int(f.tag), pos);
+                async_return(false);
+        }
+
+        pos = f.data + f.len;
+    }
+
+    async_return(true);
+}
+async_end
+
+}
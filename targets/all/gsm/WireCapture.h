@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/WireCapture.h
+ *
+ * Timestamped capture of the raw serial link and its replay
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <io/io.h>
+
+//! Inserts WireCapture between the serial port and the SimComModem driver
+#ifndef GSM_WIRE_CAPTURE
+#define GSM_WIRE_CAPTURE    0
+#endif
+
+namespace gsm
+{
+
+//! Capture format
+//!
+//! The capture starts with a WireFormat::Header, followed by records
+//! consisting of a tag byte, time since the previous record in clock ticks
+//! and data length, both encoded as unsigned LEB128, and the data itself
+struct WireFormat
+{
+    enum struct Tag : uint8_t
+    {
+        Start,      //!< the link has been (re)started, no data
+        Rx,         //!< data received from the modem
+        Tx,         //!< data transmitted to the modem
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint8_t version;
+        uint8_t reserved[3];
+        uint32_t frequency;     //!< clock ticks per second
+    };
+
+    enum
+    {
+        Version = 1,
+        //! Maximum length of the record tag and varints
+        MaxRecordHeader = 11,
+    };
+
+    static constexpr char Magic[4] = { 'G', 'S', 'M', 'W' };
+
+    static size_t PutVarint(uint8_t* buf, uint32_t value);
+    //! @returns number of bytes consumed, zero if the varint is incomplete
+    static size_t GetVarint(Span data, uint32_t& value);
+};
+
+//! Forwards the bytes between the physical pipes and the pipes used by the driver,
+//! optionally recording them into a sink
+//! Records are written with backpressure, the sink must keep up with the link,
+//! as a capture with missing data cannot be replayed
+class WireCapture
+{
+public:
+    WireCapture(io::Pipe& phyRx, io::Pipe& phyTx, io::Pipe& rx, io::Pipe& tx)
+        : phyRx(phyRx), phyTx(phyTx), rx(rx), tx(tx) {}
+
+    bool IsRunning() const { return active; }
+    bool IsCapturing() const { return capturing; }
+
+    //! Starts recording into the specified pipe, beginning with the capture header
+    void Capture(io::Pipe& sink);
+    //! Stops recording, the sink is closed when the next data passes through the link
+    void StopCapture() { capturing = false; }
+
+    //! Resets the driver side pipes, can be called only when not running
+    void Reset();
+    //! Starts forwarding, a Start record is written if capturing
+    void Start();
+
+private:
+    io::PipeReader phyRx;
+    io::PipeWriter phyTx;
+    io::Pipe& rx;
+    io::Pipe& tx;
+    io::Pipe* sink = NULL;
+
+    enum
+    {
+        RxActive = BIT(0),
+        TxActive = BIT(1),
+    };
+
+    uint8_t active = 0;
+    bool capturing = false;
+    bool headerPending = false;
+    uint8_t sinkBusy = 0;
+    mono_t last;
+
+    async(Record, WireFormat::Tag tag, Span data);
+    async(RxTask);
+    async(TxTask);
+};
+
+//! Feeds a capture to the driver, checking that it transmits the recorded bytes
+//! Data received from the modem is fed only after all data transmitted before
+//! it has been matched, so the replay follows the causality of the capture
+class WireReplay
+{
+public:
+    enum struct Pace
+    {
+        Recorded,   //!< data is fed with the recorded delays
+        Immediate,  //!< data is fed as soon as the driver is ready for it
+    };
+
+    //! @param capture complete capture including the header
+    //! @param modem the link as seen from the modem, i.e. the driver pipes swapped,
+    //! the replay writes what the driver receives and reads what it transmits
+    WireReplay(Span capture, io::DuplexPipe modem)
+        : capture(capture), input(modem), output(modem) {}
+
+    //! Position in the capture where the replay stopped
+    size_t Position() const { return pos; }
+    //! Offset of the first mismatching byte in the transmitted record
+    //! at Position(), valid if the replay failed
+    size_t MismatchOffset() const { return mismatch; }
+
+    //! Runs the replay until the end of the capture, the first mismatch
+    //! or until the driver closes its transmit pipe
+    //! @returns true if the whole capture has been replayed
+    async(Run, Pace pace = Pace::Immediate);
+
+private:
+    Span capture;
+    io::PipeReader input;
+    io::PipeWriter output;
+    size_t pos = 0, mismatch = 0;
+};
+
+}
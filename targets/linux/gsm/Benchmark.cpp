@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/Benchmark.cpp
+ */
+
+#include <gsm/Benchmark.h>
+
+#define MYDBG(...)  DBGCL("gsmbench", __VA_ARGS__)
+
+namespace gsm
+{
+
+static uint32_t Micros(mono_t ticks)
+{
+    return uint64_t(ticks) * 1000000 / MonoFromSeconds(1);
+}
+
+static size_t Position(io::Pipe& pipe)
+{
+    return io::PipeReader(pipe).Position() - io::PipePosition();
+}
+
+unsigned Benchmark::Channels(bool tls) const
+{
+    // the same limits as SimComModem::TryAllocateImpl
+    unsigned n = model == SimComEmulator::Model::SIM800 ? 6 : tls ? 2 : 10;
+    return std::min(n, std::min(settings.maxChannels, unsigned(MaxSockets)));
+}
+
+void Benchmark::Deadline()
+{
+    until = MONO_CLOCKS + MonoFromSeconds(settings.timeoutSeconds);
+}
+
+void Benchmark::Measure()
+{
+    mark.time = MONO_CLOCKS;
+    mark.rxBusy = modem.RxBusyTime();
+    mark.commands = remote.Statistics().commands;
+    mark.packets = remote.Statistics().packets;
+    mark.wireTx = Position(link.Tx());
+    mark.wireRx = Position(link.Rx());
+}
+
+async(Benchmark::Run, io::PipeWriter output, const Settings& settings)
+async_def(
+    unsigned kind, channels;
+)
+{
+    this->settings = settings;
+    this->output = output;
+    ASSERT(this->settings.exchange <= SimComEmulator::MaxData);
+
+    // plain TCP first, then TLS
+    for (f.kind = 0; f.kind < 2; f.kind++)
+    {
+        if (!(f.kind ? this->settings.tls : this->settings.tcp))
+        {
+            continue;
+        }
+
+        await(Connect, f.kind);
+        await(Upload, f.kind);
+        await(Download, f.kind);
+        for (f.channels = 1; f.channels <= Channels(f.kind); f.channels++)
+        {
+            if (!await(Scaling, f.kind, f.channels))
+            {
+                break;
+            }
+        }
+    }
+
+    MYDBG("Finished");
+}
+async_end
+
+async(Benchmark::Open, unsigned index, bool tls)
+async_def(
+    unsigned index;
+)
+{
+    f.index = index;
+    ASSERT(!sockets[f.index]);
+    sockets[f.index] = modem.CreateSocket(settings.host, settings.port, tls);
+    if (!sockets[f.index])
+    {
+        async_return(false);
+    }
+
+    async_return(await(sockets[f.index]->Connect, Timeout::Absolute(until)));
+}
+async_end
+
+async(Benchmark::Close, unsigned index)
+async_def(
+    unsigned index;
+)
+{
+    f.index = index;
+    if (sockets[f.index])
+    {
+        await(sockets[f.index]->Disconnect, Timeout::Seconds(settings.timeoutSeconds));
+        sockets[f.index]->Release();
+        sockets[f.index] = NULL;
+    }
+}
+async_end
+
+async(Benchmark::Send, unsigned index, size_t length)
+async_def(
+    unsigned index;
+    size_t length, written;
+)
+{
+    f.index = index;
+    f.length = length;
+    for (f.written = 0; f.written < f.length; )
+    {
+        size_t n = await(sockets[f.index]->Output().Write, Span(pattern, std::min(sizeof(pattern), f.length - f.written)));
+        if (!n)
+        {
+            break;
+        }
+        f.written += n;
+    }
+
+    async_return(f.written == f.length);
+}
+async_end
+
+async(Benchmark::Receive, unsigned index, size_t length)
+async_def(
+    unsigned index;
+    size_t length, received;
+)
+{
+    f.index = index;
+    f.length = length;
+    f.received = 0;
+
+    // the input is polled, so that the deadline is checked while nothing arrives
+    while (f.received < f.length && !Expired())
+    {
+        {
+            auto input = sockets[f.index]->Input();
+            size_t n = std::min(input.Available(), f.length - f.received);
+            input.Advance(n);
+            f.received += n;
+            if (!n && input.IsComplete())
+            {
+                break;
+            }
+        }
+        async_yield();
+    }
+
+    async_return(f.received == f.length);
+}
+async_end
+
+async(Benchmark::Report, const char* test, bool tls, unsigned channels, bool ok, size_t bytes)
+async_def(
+    size_t len;
+)
+{
+    {
+        uint32_t us = Micros(MONO_CLOCKS - mark.time);
+        uint32_t busy = Micros(modem.RxBusyTime() - mark.rxBusy);
+        auto& stats = remote.Statistics();
+        auto res = Buffer(line, sizeof(line)).Format(
+            "{\"test\":\"%s\",\"model\":\"%s\",\"tls\":%s,\"channels\":%u,\"ok\":%s,\"bytes\":%u,\"us\":%u,\"Bps\":%u,"
+            "\"packets\":%u,\"commands\":%u,\"wire_tx\":%u,\"wire_rx\":%u,\"rx_busy_us\":%u,\"rx_us_per_kib\":%u}\n",
+            test, model == SimComEmulator::Model::SIM800 ? "SIM800" : "SIM7600",
+            tls ? "true" : "false", channels, ok ? "true" : "false",
+            unsigned(bytes), us, us ? uint32_t(uint64_t(bytes) * 1000000 / us) : 0,
+            stats.packets - mark.packets, stats.commands - mark.commands,
+            unsigned(Position(link.Tx()) - mark.wireTx), unsigned(Position(link.Rx()) - mark.wireRx),
+            busy, bytes ? uint32_t(uint64_t(busy) * 1024 / bytes) : 0);
+        f.len = res.end() - line;
+        MYDBG("%b", Span(line, f.len - 1));
+    }
+
+    await(output.Write, Span(line, f.len));
+}
+async_end
+
+async(Benchmark::Connect, bool tls)
+async_def(
+    bool tls, ok;
+)
+{
+    // from creating the socket to the first byte of the response to a request,
+    // the first run includes the start of the modem
+    f.tls = tls;
+    mode = Mode::Echo;
+    Deadline();
+    Measure();
+    f.ok = await(Open, 0, f.tls) &&
+        await(Send, 0, 1) &&
+        await(Receive, 0, 1);
+    await(Report, "connect", f.tls, 1, f.ok, 1);
+    await(Close, 0);
+}
+async_end
+
+async(Benchmark::Upload, bool tls)
+async_def(
+    bool tls, ok;
+    uint32_t seen;
+)
+{
+    f.tls = tls;
+    mode = Mode::Sink;
+    uploaded = 0;
+    Deadline();
+    if ((f.ok = await(Open, 0, f.tls)))
+    {
+        Measure();
+        await(Send, 0, settings.transfer);
+
+        // until the remote side receives everything
+        while (uploaded < settings.transfer && !Expired())
+        {
+            f.seen = uploaded;
+            await_mask_not_timeout(uploaded, ~0u, f.seen, Timeout::Absolute(until));
+        }
+        f.ok = uploaded == settings.transfer;
+    }
+    else
+    {
+        Measure();
+    }
+
+    await(Report, "upload", f.tls, 1, f.ok, uploaded);
+    await(Close, 0);
+}
+async_end
+
+async(Benchmark::Download, bool tls)
+async_def(
+    bool tls, ok;
+    unsigned ch;
+    bool secure;
+    size_t delivered, received;
+)
+{
+    f.tls = tls;
+    mode = Mode::Echo;
+    f.received = 0;
+    Deadline();
+    if ((f.ok = await(Open, 0, f.tls)))
+    {
+        f.ch = lastChannel;
+        f.secure = lastSecure;
+        Measure();
+        for (f.delivered = 0; f.received < settings.transfer && !Expired(); )
+        {
+            {
+                // the remote side is fed as fast as the emulated modem buffers the data
+                size_t n = std::min(sizeof(pattern), settings.transfer - f.delivered);
+                f.delivered += n ? remote.Deliver(f.ch, f.secure, Span(pattern, n)) : 0;
+
+                auto input = sockets[0]->Input();
+                n = input.Available();
+                input.Advance(n);
+                f.received += n;
+                if (!n && input.IsComplete())
+                {
+                    break;
+                }
+            }
+            async_yield();
+        }
+        f.ok = f.received == settings.transfer;
+    }
+    else
+    {
+        Measure();
+    }
+
+    await(Report, "download", f.tls, 1, f.ok, f.received);
+    await(Close, 0);
+}
+async_end
+
+async(Benchmark::Scaling, bool tls, unsigned channels)
+async_def(
+    bool tls, ok;
+    unsigned channels, i;
+)
+{
+    // all sockets send their data first, then all the echoes are collected
+    f.tls = tls;
+    f.channels = channels;
+    mode = Mode::Echo;
+    Deadline();
+    Measure();
+    f.ok = true;
+    for (f.i = 0; f.ok && f.i < f.channels; f.i++)
+    {
+        f.ok = await(Open, f.i, f.tls);
+    }
+
+    if (f.ok)
+    {
+        Measure();
+        for (f.i = 0; f.ok && f.i < f.channels; f.i++)
+        {
+            f.ok = await(Send, f.i, settings.exchange);
+        }
+        for (f.i = 0; f.ok && f.i < f.channels; f.i++)
+        {
+            f.ok = await(Receive, f.i, settings.exchange);
+        }
+    }
+
+    await(Report, "scaling", f.tls, f.channels, f.ok, f.ok ? f.channels * settings.exchange * 2 : 0);
+    for (f.i = 0; f.i < f.channels; f.i++)
+    {
+        await(Close, f.i);
+    }
+    async_return(f.ok);
+}
+async_end
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/Benchmark.h
+ *
+ * End-to-end measurements of the socket data path against an emulated modem
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <io/io.h>
+
+#include <gsm/EmulatorLink.h>
+#include <gsm/SimComModem.h>
+
+namespace gsm
+{
+
+//! Runs SimComModem against SimComEmulator connected through an EmulatorLink
+//! and writes the results as JSON, one object per line:
+//! {"test":"upload","model":"SIM800","tls":false,"channels":1,"ok":true,"bytes":32768,"us":..,"Bps":..,
+//!  "packets":..,"commands":..,"wire_tx":..,"wire_rx":..,"rx_busy_us":..,"rx_us_per_kib":..}
+//! The counters are the differences over the measured interval, packets and commands
+//! as counted by the emulator, wire_tx and wire_rx are the bytes passed over the link
+//! in each direction, so the AT overhead per packet is (wire_tx - bytes) / packets
+//! for uploads and (wire_rx - bytes) / packets for downloads
+//! The link characteristics are set by Emulator().Configure(), the default profile
+//! has no delays, so the results show the cost of the driver itself
+class Benchmark
+{
+public:
+    struct Settings
+    {
+        const char* host = "192.0.2.1";
+        unsigned port = 7;
+        bool tcp = true, tls = true;    //!< kinds of sockets measured
+        size_t transfer = 32768;        //!< bytes uploaded and downloaded by the throughput tests
+        size_t exchange = 1024;         //!< bytes echoed by each socket in the scaling tests
+        unsigned maxChannels = 10;      //!< limit of the scaling tests, the modem limits them as well
+        unsigned timeoutSeconds = 60;   //!< limit of each test
+    };
+
+    Benchmark(ModemOptions& options, SimComEmulator::Model model)
+        : model(model), remote(*this, model, link.Remote()), modem(options, link)
+    {
+        link.Attach(remote);
+        for (size_t i = 0; i < sizeof(pattern); i++)
+        {
+            pattern[i] = 'A' + i % 26;
+        }
+    }
+
+    SimComEmulator& Emulator() { return remote; }
+    SimComModem& Driver() { return modem; }
+
+    //! Runs all the tests, the modem is started by the first one and left running
+    async(Run, io::PipeWriter output, const Settings& settings);
+
+private:
+    enum
+    {
+        MaxSockets = 10,
+    };
+
+    enum struct Mode : uint8_t
+    {
+        Echo,       //!< the data is sent back
+        Sink,       //!< the data is only counted
+    };
+
+    //! Remote side of the connections
+    class Remote : public SimComEmulator
+    {
+    public:
+        Remote(Benchmark& owner, Model model, io::DuplexPipe pipe)
+            : SimComEmulator(model, pipe), owner(owner) {}
+
+    protected:
+        virtual bool OnConnect(unsigned ch, bool secure, Span host, unsigned port) override
+        {
+            owner.lastChannel = ch;
+            owner.lastSecure = secure;
+            return true;
+        }
+
+        virtual void OnData(unsigned ch, bool secure, Span data) override
+        {
+            owner.uploaded += data.Length();
+            if (owner.mode == Mode::Echo)
+            {
+                Deliver(ch, secure, data);
+            }
+        }
+
+    private:
+        Benchmark& owner;
+    };
+
+    //! Counters at the start of a test
+    struct Mark
+    {
+        mono_t time, rxBusy;
+        uint32_t commands, packets;
+        size_t wireTx, wireRx;
+    };
+
+    SimComEmulator::Model model;
+    EmulatorLink link;
+    Remote remote;
+    SimComModem modem;
+
+    Settings settings;
+    io::PipeWriter output;
+    Socket* sockets[MaxSockets] = {};
+    Mode mode = Mode::Echo;
+    uint32_t uploaded = 0;
+    unsigned lastChannel = 0;
+    bool lastSecure = false;
+    Mark mark;
+    mono_t until;
+    char pattern[256];
+    char line[384];
+
+    unsigned Channels(bool tls) const;
+    //! Starts the time limit of a test
+    void Deadline();
+    //! Starts the measured interval
+    void Measure();
+    bool Expired() const { return OVF_DIFF(MONO_CLOCKS, until) >= 0; }
+
+    async(Open, unsigned index, bool tls);
+    async(Close, unsigned index);
+    async(Send, unsigned index, size_t length);
+    //! Waits until the specified number of bytes is received on the socket
+    async(Receive, unsigned index, size_t length);
+    async(Report, const char* test, bool tls, unsigned channels, bool ok, size_t bytes);
+
+    async(Connect, bool tls);
+    async(Upload, bool tls);
+    async(Download, bool tls);
+    async(Scaling, bool tls, unsigned channels);
+};
+
+}
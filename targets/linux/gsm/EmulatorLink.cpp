@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/EmulatorLink.cpp
+ */
+
+#include <gsm/EmulatorLink.h>
+
+namespace gsm
+{
+
+async(EmulatorLink::Start)
+async_def()
+{
+    ASSERT(emulator);
+    emulator->Start();
+    async_return(true);
+}
+async_end
+
+async(EmulatorLink::Stop)
+async_def()
+{
+    // the emulator finishes when the driver closes its output
+    if (!await(emulator->WaitForStop, Timeout::Seconds(1)))
+    {
+        io::PipeWriter(rx).Close();
+    }
+    on = false;
+}
+async_end
+
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/EmulatorLink.h
+ *
+ * Serial link connecting the driver to a SimComEmulator in the same process
+ */
+
+#pragma once
+
+#include <gsm/SerialLink.h>
+#include <gsm/SimComEmulator.h>
+
+namespace gsm
+{
+
+//! The emulated modem is started by the power key and stopped together with the link,
+//! the port settings have no effect
+//! The emulator is created separately (usually a subclass scripting the remote side)
+//! on the pipes returned by Remote() and then attached to the link
+class EmulatorLink : public SerialLink
+{
+public:
+    //! The link as seen from the modem
+    io::DuplexPipe Remote() { return io::DuplexPipe(tx, rx); }
+    void Attach(SimComEmulator& emulator) { this->emulator = &emulator; }
+
+    virtual async(Start) override;
+    virtual async(Stop) override;
+    virtual void Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl) override {}
+
+    virtual void Power(bool on) override { powered = on; if (!on) this->on = false; }
+    virtual void PowerKey(bool pressed) override { if (pressed && powered) on = true; }
+    virtual bool IsOn() override { return on; }
+
+private:
+    SimComEmulator* emulator = NULL;
+    bool powered = false, on = false;
+};
+
+}
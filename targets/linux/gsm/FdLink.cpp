@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/FdLink.cpp
+ */
+
+#include <gsm/FdLink.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#define MYDBG(...)  DBGCL("gsmfd", __VA_ARGS__)
+
+namespace gsm
+{
+
+static speed_t Speed(unsigned baudRate)
+{
+    switch (baudRate)
+    {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        case 3000000: return B3000000;
+        case 4000000: return B4000000;
+        default: return B0;
+    }
+}
+
+async(FdLink::Start)
+async_def()
+{
+    if (path)
+    {
+        fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+        {
+            MYDBG("!! Failed to open %s: %d", path, errno);
+            io::PipeWriter(rx).Close();
+            async_return(false);
+        }
+    }
+    else
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    tty = isatty(fd);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    {
+        epoll_event ev = {};
+        ev.events = armed = EPOLLIN;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        watchOutput = false;
+    }
+
+    ready = 0;
+    active = RxActive | TxActive | PollActive;
+    kernel::Task::Run(this, &FdLink::RxTask);
+    kernel::Task::Run(this, &FdLink::TxTask);
+    kernel::Task::Run(this, &FdLink::PollTask);
+    async_return(true);
+}
+async_end
+
+async(FdLink::Stop)
+async_def()
+{
+    if (epfd < 0)
+    {
+        // never started, or the device could not be opened
+        async_return(false);
+    }
+
+    // the transmit task finishes when the driver closes its output
+    ready |= Stopping;
+    await_mask(active, RxActive | TxActive | PollActive, 0);
+
+    close(epfd);
+    epfd = -1;
+    if (path)
+    {
+        close(fd);
+        fd = -1;
+    }
+    async_return(true);
+}
+async_end
+
+void FdLink::Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl)
+{
+    if (!tty)
+    {
+        return;
+    }
+
+    termios t;
+    if (tcgetattr(fd, &t))
+    {
+        MYDBG("!! Failed to get port settings: %d", errno);
+        return;
+    }
+
+    cfmakeraw(&t);
+    if (speed_t speed = Speed(baudRate))
+    {
+        cfsetspeed(&t, speed);
+    }
+    else
+    {
+        // USB serial ports ignore the rate anyway
+        MYDBG("Unsupported baud rate %d, keeping the current one", baudRate);
+    }
+
+    t.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD | CMSPAR | CRTSCTS);
+    t.c_cflag |= CS8 | CLOCAL | CREAD;
+    switch (parity)
+    {
+        case ModemOptions::Parity::Even: t.c_cflag |= PARENB; break;
+        case ModemOptions::Parity::Odd: t.c_cflag |= PARENB | PARODD; break;
+        case ModemOptions::Parity::Mark: t.c_cflag |= PARENB | PARODD | CMSPAR; break;
+        case ModemOptions::Parity::Space: t.c_cflag |= PARENB | CMSPAR; break;
+        default: break;
+    }
+    if (parity != ModemOptions::Parity::Off)
+    {
+        // drop bytes with parity errors, as the USART does
+        t.c_iflag |= INPCK | IGNPAR;
+    }
+    if (flowControl)
+    {
+        t.c_cflag |= CRTSCTS;
+    }
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSADRAIN, &t))
+    {
+        MYDBG("!! Failed to change port settings: %d", errno);
+    }
+}
+
+void FdLink::AllowSleep(bool allow)
+{
+    if (tty)
+    {
+        int bits = TIOCM_DTR;
+        ioctl(fd, allow ? TIOCMBIC : TIOCMBIS, &bits);
+    }
+}
+
+void FdLink::Arm()
+{
+    if (ready & Hangup)
+    {
+        return;
+    }
+
+    // epoll is level-triggered, input is not watched while it is known to be
+    // readable, i.e. while the receive pipe is full, or when nobody reads it anymore
+    uint32_t events = (ready & (Readable | Stopping) ? 0 : EPOLLIN) | (watchOutput ? EPOLLOUT : 0);
+    if (events != armed)
+    {
+        epoll_event ev = {};
+        ev.events = events;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        armed = events;
+    }
+}
+
+async(FdLink::RxTask)
+async_def(
+    char buf[512];
+    size_t len;
+)
+{
+    while (!(ready & Stopping))
+    {
+        {
+            ssize_t res = read(fd, f.buf, sizeof(f.buf));
+            if (res < 0 && (errno == EAGAIN || errno == EINTR) && !(ready & Hangup))
+            {
+                ready &= ~Readable;
+                f.len = 0;
+            }
+            else if (res <= 0)
+            {
+                // e.g. the other end of a pty or socketpair has been closed
+                MYDBG("!! Input closed: %d", res < 0 ? errno : 0);
+                break;
+            }
+            else
+            {
+                f.len = res;
+            }
+        }
+
+        if (f.len)
+        {
+            await(io::PipeWriter(rx).Write, Span(f.buf, f.len));
+        }
+        else
+        {
+            await_mask_not(ready, Readable | Stopping, 0);
+        }
+    }
+
+    io::PipeWriter(rx).Close();
+    MYDBG("RX Stopped");
+    active &= ~RxActive;
+}
+async_end
+
+async(FdLink::TxTask)
+async_def()
+{
+    while (await(io::PipeReader(tx).Require))
+    {
+        {
+            Span data = io::PipeReader(tx).GetSpan();
+            ssize_t res = write(fd, data.Pointer(), data.Length());
+            if (res > 0)
+            {
+                io::PipeReader(tx).Advance(res);
+                continue;
+            }
+            if ((res < 0 && errno != EAGAIN && errno != EINTR) || (ready & Hangup))
+            {
+                MYDBG("!! Output failed: %d", errno);
+                // discard the data, the driver notices the missing responses
+                io::PipeReader(tx).Advance(data.Length());
+                continue;
+            }
+        }
+
+        ready &= ~Writable;
+        Watch(true);
+        await_mask_not(ready, Writable | Stopping, 0);
+        Watch(false);
+    }
+
+    MYDBG("TX Stopped");
+    active &= ~TxActive;
+}
+async_end
+
+async(FdLink::PollTask)
+async_def(
+    bool busy;
+)
+{
+    // the scheduler cannot wait for descriptors, readiness is checked
+    // without blocking and the task sleeps while there is nothing to do
+    while (!(ready & Stopping) || (active & (RxActive | TxActive)))
+    {
+        {
+            Arm();
+            epoll_event ev;
+            if (!(ready & Hangup) && epoll_wait(epfd, &ev, 1, 0) > 0)
+            {
+                if (ev.events & (EPOLLHUP | EPOLLERR))
+                {
+                    // reported regardless of the armed events and never cleared,
+                    // let both tasks fail on the descriptor instead of spinning
+                    MYDBG("!! Descriptor hung up: %X", ev.events);
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+                    ready |= Readable | Writable | Hangup;
+                }
+                if (ev.events & EPOLLIN)
+                {
+                    ready |= Readable;
+                }
+                if (ev.events & EPOLLOUT)
+                {
+                    ready |= Writable;
+                }
+                f.busy = true;
+            }
+            else
+            {
+                f.busy = false;
+            }
+        }
+
+        if (f.busy)
+        {
+            async_yield();
+        }
+        else
+        {
+            async_delay_ms(pollMs);
+        }
+    }
+
+    active &= ~PollActive;
+}
+async_end
+
+}
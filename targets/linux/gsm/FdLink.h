@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/FdLink.h
+ *
+ * Modem connected to a tty or any other non-blocking file descriptor on a Linux host
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+
+#include <gsm/SerialLink.h>
+
+namespace gsm
+{
+
+//! The modem is assumed to be always on and its power cannot be controlled,
+//! override Power, PowerKey and IsOn to control it using other means
+//! (e.g. GPIO lines of the gateway)
+//! A pty pair or socketpair can be used in place of a real tty,
+//! the port settings are then ignored
+class FdLink : public SerialLink
+{
+public:
+    //! Uses an already open file descriptor, it is left open when stopped
+    FdLink(int fd)
+        : fd(fd) {}
+    //! Opens the device (e.g. /dev/ttyUSB2) when started and closes it when stopped
+    FdLink(const char* path)
+        : path(path) {}
+
+    virtual async(Start) override;
+    virtual async(Stop) override;
+    virtual void Configure(unsigned baudRate, ModemOptions::Parity parity, bool flowControl) override;
+    //! Deasserts DTR to allow sleep, if the descriptor is a tty
+    virtual void AllowSleep(bool allow) override;
+
+    //! Sets the interval of readiness checks while the link is idle
+    void PollInterval(unsigned ms) { pollMs = ms; }
+
+private:
+    enum
+    {
+        // ready flags
+        Readable = BIT(0),
+        Writable = BIT(1),
+        Stopping = BIT(2),
+        //! The descriptor hung up or failed, it is no longer polled
+        Hangup = BIT(3),
+
+        // active tasks
+        RxActive = BIT(0),
+        TxActive = BIT(1),
+        PollActive = BIT(2),
+    };
+
+    const char* path = NULL;
+    int fd = -1, epfd = -1;
+    bool tty = false;
+    bool watchOutput = false;
+    uint32_t armed = 0;
+    uint8_t ready = 0, active = 0;
+    unsigned pollMs = 1;
+
+    void Watch(bool output) { watchOutput = output; }
+    void Arm();
+
+    async(RxTask);
+    async(TxTask);
+    async(PollTask);
+};
+
+}
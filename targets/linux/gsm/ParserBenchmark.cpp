@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ParserBenchmark.cpp
+ */
+
+#include <gsm/ParserBenchmark.h>
+
+#define MYDBG(...)  DBGCL("gsmparse", __VA_ARGS__)
+
+namespace gsm
+{
+
+//! Received lines without the CRLF, with the kinds of their fields
+//! n = InputFieldNum, h = InputFieldHex, s = InputFieldFnv
+static const struct
+{
+    const char* line;
+    const char* fields;
+} corpus[] = {
+    { "+CCHRECV: DATA,1,1024", "snn" },
+    { "+CCHRECV: LEN,0,512", "snn" },
+    { "+CCHRECV: 1,0", "nn" },
+    { "+RECEIVE,0,1024:", "nn" },
+    { "+CPSI: LTE,Online,230-03,0x2C1F,27447553,256,EUTRAN-BAND20,6200,5,5,-94,-1007,-710,16", "sssnnnsnnnnnnn" },
+    { "+CREG: 1,\"00A1\",\"0B2C\"", "nhh" },
+    { "+CREG: 2,5,\"2C1F\",\"01A2B3C4\"", "nnhh" },
+    { "+CGREG: 1,\"2C1F\",\"01A2B3C4\",7", "nhhn" },
+    { "+CSQ: 18,99", "nn" },
+};
+
+//! Segment sizes, zero stores each line in a single segment
+static const uint8_t splits[] = { 0, 1, 4, 16 };
+
+async(ParserBenchmark::Run, io::PipeWriter output, unsigned iterations)
+async_def(
+    io::PipeWriter output;
+    unsigned iterations;
+    unsigned split;
+    mono_t ticks;
+)
+{
+    f.output = output;
+    f.iterations = iterations;
+
+    for (f.split = 0; f.split < Splits; f.split++)
+    {
+        await(Fill, splits[f.split]);
+
+        f.ticks = Hash(f.iterations);
+        await(Report, f.output, Bench::Hash, splits[f.split], f.iterations, f.ticks);
+        f.ticks = Fields(f.iterations);
+        await(Report, f.output, Bench::Fields, splits[f.split], f.iterations, f.ticks);
+        await(Dispatch, f.iterations);
+        await(Report, f.output, Bench::Dispatch, splits[f.split], f.iterations, dispatchTicks);
+    }
+
+    MYDBG("Finished");
+}
+async_end
+
+async(ParserBenchmark::Fill, size_t split)
+async_def(
+    size_t split;
+    unsigned i;
+    size_t pos, len;
+)
+{
+    static_assert(sizeof(corpus) / sizeof(corpus[0]) == CorpusLines, "corpus size mismatch");
+    f.split = split;
+    bytes = 0;
+    for (f.i = 0; f.i < CorpusLines; f.i++)
+    {
+        lines[f.i].Reset();
+        f.len = lengths[f.i] = strlen(corpus[f.i].line);
+        bytes += f.len;
+
+        // each piece is moved from the scratch pipe, so that it ends up
+        // in a segment of its own, like the chunks received by the USART
+        for (f.pos = 0; f.pos < f.len; f.pos += f.split ? f.split : f.len)
+        {
+            scratch.Reset();
+            {
+                size_t n = f.split ? std::min(f.split, f.len - f.pos) : f.len;
+                await(io::PipeWriter(scratch).Write, Span(corpus[f.i].line + f.pos, n));
+            }
+            await(io::PipeReader(scratch).MoveTo, io::PipeWriter(lines[f.i]), io::PipeReader(scratch).Available());
+        }
+
+        {
+            // the header is hashed once more to find the start of the fields
+            io::Pipe::Iterator iter = io::PipeReader(lines[f.i]).Enumerate(f.len);
+            hashes[f.i] = HashHeader(iter);
+            if (iter && *iter == ':')
+            {
+                ++iter;
+                if (iter && *iter == ' ')
+                {
+                    ++iter;
+                }
+            }
+            fields[f.i] = iter;
+        }
+    }
+}
+async_end
+
+mono_t ParserBenchmark::Hash(unsigned iterations)
+{
+    mono_t start = MONO_CLOCKS;
+    uint32_t sum = 0;
+    for (unsigned n = 0; n < iterations; n++)
+    {
+        for (unsigned i = 0; i < CorpusLines; i++)
+        {
+            io::Pipe::Iterator iter = io::PipeReader(lines[i]).Enumerate(lengths[i]);
+            sum += HashHeader(iter);
+        }
+    }
+    mono_t ticks = MONO_CLOCKS - start;
+
+    // uses the results and makes sure they do not depend on the split
+    uint32_t expected = 0;
+    for (auto& hash: hashes)
+    {
+        expected += hash;
+    }
+    ASSERT(sum == expected * iterations);
+    return ticks;
+}
+
+mono_t ParserBenchmark::Fields(unsigned iterations)
+{
+    mono_t start = MONO_CLOCKS;
+    int sum = 0;
+    for (unsigned n = 0; n < iterations; n++)
+    {
+        for (unsigned i = 0; i < CorpusLines; i++)
+        {
+            InputField() = fields[i];
+            sum += InputFieldCount();
+            for (const char* kind = corpus[i].fields; *kind; kind++)
+            {
+                int num;
+                uint32_t fnv;
+                switch (*kind)
+                {
+                    case 'n': InputFieldNum(num); sum += num; break;
+                    case 'h': InputFieldHex(num); sum += num; break;
+                    default: InputFieldFnv(fnv); sum += fnv; break;
+                }
+            }
+        }
+    }
+    mono_t ticks = MONO_CLOCKS - start;
+
+    UNUSED volatile int keep = sum;
+    return ticks;
+}
+
+async(ParserBenchmark::Dispatch, unsigned iterations)
+async_def(
+    unsigned iterations;
+    unsigned n, i;
+    mono_t start;
+)
+{
+    // OnEvent completes synchronously, so no other task runs during the measurement
+    f.iterations = iterations;
+    f.start = MONO_CLOCKS;
+    for (f.n = 0; f.n < f.iterations; f.n++)
+    {
+        for (f.i = 0; f.i < CorpusLines; f.i++)
+        {
+            InputField() = fields[f.i];
+            await(OnEvent, hashes[f.i]);
+            // nothing is to be received, there are no sockets
+            ReceiveForSocket(NULL, 0);
+        }
+    }
+    dispatchTicks = MONO_CLOCKS - f.start;
+}
+async_end
+
+async(ParserBenchmark::Report, io::PipeWriter output, Bench bench, size_t split, unsigned iterations, mono_t ticks)
+async_def(
+    io::PipeWriter output;
+    size_t len;
+)
+{
+    f.output = output;
+    {
+        unsigned count = CorpusLines * iterations;
+        uint64_t total = uint64_t(bytes) * iterations;
+        auto res = Buffer(line, sizeof(line)).Format(
+            "{\"bench\":\"%s\",\"split\":%u,\"lines\":%u,\"bytes\":%u,\"ticks\":%u,\"tick_hz\":%u,\"ticks_per_line\":%u,\"ticks_per_kib\":%u}\n",
+            STRINGS("hash", "fields", "dispatch")[int(bench)], unsigned(split), count, unsigned(total),
+            unsigned(ticks), unsigned(MonoFromSeconds(1)),
+            count ? unsigned(ticks / count) : 0, total ? unsigned(uint64_t(ticks) * 1024 / total) : 0);
+        f.len = res.end() - line;
+        MYDBG("%b", Span(line, f.len - 1));
+    }
+
+    await(f.output.Write, Span(line, f.len));
+}
+async_end
+
+}
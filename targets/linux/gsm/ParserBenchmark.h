@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/ParserBenchmark.h
+ *
+ * Microbenchmarks of the received line parsing
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <io/io.h>
+
+#include <gsm/SimComModem.h>
+
+namespace gsm
+{
+
+//! Measures the header hashing of Modem::RxTask, the InputField decoding
+//! and SimComModem::OnEvent dispatch over a corpus of unsolicited result codes
+//! The corpus is stored in the pipes split into segments of different sizes,
+//! the results are written as JSON, one object per line:
+//! {"bench":"hash","split":1,"lines":..,"bytes":..,"ticks":..,"tick_hz":..,"ticks_per_line":..,"ticks_per_kib":..}
+//! The times are measured in MONO_CLOCKS ticks
+//! The benchmark is a driver of its own, which is never started, so that it can
+//! use the parser without the driver exposing it
+class ParserBenchmark : SimComModem
+{
+public:
+    //! @param serial the link of the driver, it is not used
+    ParserBenchmark(ModemOptions& options, SerialLink& serial)
+        : SimComModem(options, serial) {}
+
+    //! Runs all the measurements, repeating each pass over the corpus the specified number of times
+    async(Run, io::PipeWriter output, unsigned iterations = 100);
+
+private:
+    enum
+    {
+        CorpusLines = 9,
+        Splits = 4,
+    };
+
+    enum struct Bench : uint8_t
+    {
+        Hash,
+        Fields,
+        Dispatch,
+    };
+
+    io::Pipe lines[CorpusLines];
+    io::Pipe scratch;
+    io::Pipe::Iterator fields[CorpusLines];
+    FNV1a hashes[CorpusLines];
+    size_t lengths[CorpusLines];
+    size_t bytes;
+    mono_t dispatchTicks;
+    char line[256];
+
+    //! Stores the corpus in the pipes, in segments of the specified size
+    async(Fill, size_t split);
+    mono_t Hash(unsigned iterations);
+    mono_t Fields(unsigned iterations);
+    async(Dispatch, unsigned iterations);
+    async(Report, io::PipeWriter output, Bench bench, size_t split, unsigned iterations, mono_t ticks);
+};
+
+}
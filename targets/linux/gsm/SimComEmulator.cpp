@@ -0,0 +1,995 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/SimComEmulator.cpp
+ */
+
+#include <gsm/SimComEmulator.h>
+
+#define MYDBG(...)  DBGCL("gsmemu", __VA_ARGS__)
+
+#define CMD(...)    Line(cmdOut, cmdLen, sizeof(cmdOut), __VA_ARGS__)
+#define EVT(...)    Line(evtOut, evtLen, sizeof(evtOut), __VA_ARGS__)
+
+namespace gsm
+{
+
+//! Comma separated command arguments, numbers and strings may be quoted
+class EmulatorArgs
+{
+public:
+    EmulatorArgs(const char* p, const char* end)
+        : p(p), end(end) {}
+
+    bool Int(int& n)
+    {
+        bool quoted = Skip('"');
+        const char* start = p;
+        n = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            n = n * 10 + *p++ - '0';
+        }
+        if (quoted && !Skip('"'))
+        {
+            return false;
+        }
+        return p != start && Next();
+    }
+
+    bool Str(Span& s)
+    {
+        if (!Skip('"'))
+        {
+            return false;
+        }
+        const char* start = p;
+        while (p < end && *p != '"')
+        {
+            p++;
+        }
+        s = Span(start, p - start);
+        return Skip('"') && Next();
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    bool Skip(char c) { if (p < end && *p == c) { p++; return true; } return false; }
+    bool Next() { return p == end || Skip(','); }
+};
+
+static bool Is(const char* cmd, size_t len, const char* s)
+{
+    return strlen(s) == len && !memcmp(cmd, s, len);
+}
+
+static bool Starts(const char* cmd, size_t len, const char* s, size_t& n)
+{
+    n = strlen(s);
+    return len >= n && !memcmp(cmd, s, n);
+}
+
+void SimComEmulator::Start()
+{
+    ASSERT(!active);
+    echo = true;
+    registered = attached = ssl = false;
+    netOpen = cchStarted = false;
+    creg = cgreg = 0;
+    outputBusy = 0;
+    memset(channels, 0, sizeof(channels));
+    memset(events, 0, sizeof(events));
+
+    running = true;
+    active = CommandActive | EventActive;
+    Schedule(EventType::PowerOn, 0, 0);
+    Schedule(EventType::Registration, 0, MonoFromMilliseconds(profile.registrationMs));
+    kernel::Task::Run(this, &SimComEmulator::CommandTask);
+    kernel::Task::Run(this, &SimComEmulator::EventTask);
+}
+
+async(SimComEmulator::WaitForStop, Timeout timeout)
+async_def()
+{
+    async_return(await_mask_timeout(active, CommandActive | EventActive, 0, timeout));
+}
+async_end
+
+SimComEmulator::Channel* SimComEmulator::Find(unsigned ch, bool secure)
+{
+    if (model == Model::SIM800)
+    {
+        // the channel is switched to TLS by +CIPSSL before connecting
+        return ch < 6 ? &channels[ch] : NULL;
+    }
+
+    if (secure)
+    {
+        return ch < SecureChannels ? &channels[Channels + ch] : NULL;
+    }
+
+    return ch < Channels ? &channels[ch] : NULL;
+}
+
+bool SimComEmulator::Inject(uint16_t permille)
+{
+    if (!permille)
+    {
+        return false;
+    }
+
+    // xorshift32, the sequence depends only on the seed
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd % 1000 < permille;
+}
+
+unsigned SimComEmulator::Transfer(size_t len) const
+{
+    return profile.bandwidth ? uint64_t(len) * 1000 / profile.bandwidth : 0;
+}
+
+void SimComEmulator::Schedule(EventType type, unsigned index, mono_t delay, bool success)
+{
+    for (auto& e: events)
+    {
+        if (e.type == EventType::None)
+        {
+            e.due = MONO_CLOCKS + delay;
+            e.type = type;
+            e.index = index;
+            e.success = success;
+            wake++;
+            return;
+        }
+    }
+
+    MYDBG("!! Event queue full, event %d lost", int(type));
+}
+
+size_t SimComEmulator::Deliver(unsigned ch, bool secure, Span data)
+{
+    Channel* c = Find(ch, secure);
+    if (!c || !c->open)
+    {
+        return 0;
+    }
+
+    if (Inject(profile.lossPermille))
+    {
+        stats.lost++;
+        return data.Length();
+    }
+
+    size_t len = std::min(data.Length(), sizeof(c->data) - c->length);
+    if (len)
+    {
+        bool scheduled = c->length;
+        memcpy(c->data + c->length, data.Pointer(), len);
+        c->length += len;
+        if (!scheduled)
+        {
+            Schedule(EventType::Data, Index(*c), MonoFromMilliseconds(profile.latencyMs + Transfer(len)));
+        }
+    }
+    return len;
+}
+
+void SimComEmulator::PeerClose(unsigned ch, bool secure)
+{
+    if (Channel* c = Find(ch, secure))
+    {
+        Schedule(EventType::PeerClose, Index(*c), MonoFromMilliseconds(profile.latencyMs));
+    }
+}
+
+void SimComEmulator::Register(bool registered)
+{
+    Schedule(EventType::Registration, 0, 0, registered);
+}
+
+void SimComEmulator::Line(char* buf, size_t& len, size_t size, const char* format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    if (size - len > 4)
+    {
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+        // the final CRLF always fits
+        len += Buffer(buf + len, size - len - 2).FormatVA(format, va).Length();
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+    }
+    else
+    {
+        MYDBG("!! Response too long");
+    }
+    va_end(va);
+}
+
+SimComEmulator::Result SimComEmulator::Execute(const char* cmd, size_t len)
+{
+    size_t n;
+    int ch, value;
+    Span s;
+
+    if (!len || Is(cmd, len, "&W"))
+    {
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "E0") || Is(cmd, len, "E1"))
+    {
+        echo = cmd[1] == '1';
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "I"))
+    {
+        if (model == Model::SIM800)
+        {
+            CMD("SIM800 R14.18");
+        }
+        else
+        {
+            CMD("Manufacturer: SIMCOM INCORPORATED");
+            CMD("Model: SIMCOM_SIM7600E-H");
+            CMD("Revision: LE20B04SIM7600M22");
+        }
+        return Result::OK;
+    }
+
+    if (model == Model::SIM800 && Is(cmd, len, "+GSV"))
+    {
+        CMD("SIMCOM_Ltd");
+        CMD("SIMCOM_SIM800");
+        CMD("Revision:1418B05SIM800C24");
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+CFUN?"))
+    {
+        CMD("+CFUN: 1");
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+CPIN?"))
+    {
+        CMD("+CPIN: READY");
+        return Result::OK;
+    }
+
+    if (Starts(cmd, len, "+CREG=", n) || Starts(cmd, len, "+CGREG=", n))
+    {
+        if (!EmulatorArgs(cmd + n, cmd + len).Int(value))
+        {
+            return Result::Error;
+        }
+        (cmd[2] == 'G' ? cgreg : creg) = value;
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+CREG?") || Is(cmd, len, "+CGREG?"))
+    {
+        bool gprs = cmd[2] == 'G';
+        uint8_t mode = gprs ? cgreg : creg;
+        int stat = registered && (!gprs || attached) ? 1 : 2;
+        if (mode == 2)
+        {
+            CMD("%s: %d,%d,\"00A1\",\"0B2C\"", gprs ? "+CGREG" : "+CREG", mode, stat);
+        }
+        else
+        {
+            CMD("%s: %d,%d", gprs ? "+CGREG" : "+CREG", mode, stat);
+        }
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+COPS?"))
+    {
+        CMD(registered ? "+COPS: 0,0,\"EMULATED\"" : "+COPS: 0");
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+CSQ"))
+    {
+        CMD("+CSQ: %d,0", registered ? 20 : 99);
+        return Result::OK;
+    }
+
+    if (Starts(cmd, len, "+CGATT=", n))
+    {
+        if (!EmulatorArgs(cmd + n, cmd + len).Int(value))
+        {
+            return Result::Error;
+        }
+        attached = value;
+        if (cgreg && registered)
+        {
+            CMD("+CGREG: %d,\"00A1\",\"0B2C\"", attached ? 1 : 2);
+        }
+        return Result::OK;
+    }
+
+    if (Is(cmd, len, "+CGACT?"))
+    {
+        CMD("+CGACT: 1,%d", netOpen);
+        return Result::OK;
+    }
+
+    if (Starts(cmd, len, "+CDNSGIP=", n))
+    {
+        if (!EmulatorArgs(cmd + n, cmd + len).Str(s))
+        {
+            return Result::Error;
+        }
+        // SIM7600 sends the result before OK, SIM800 after it
+        if (model == Model::SIM800)
+        {
+            CMD("OK");
+        }
+        CMD("+CDNSGIP: 1,\"%b\",\"10.1.0.1\"", s);
+        if (model == Model::SIM7600)
+        {
+            CMD("OK");
+        }
+        return Result::Done;
+    }
+
+    if (model == Model::SIM800)
+    {
+        if (Is(cmd, len, "+CIPMUX?"))
+        {
+            CMD("+CIPMUX: 1");
+            return Result::OK;
+        }
+
+        if (Is(cmd, len, "+CIPSTATUS"))
+        {
+            CMD("OK");
+            CMD("STATE: %s", netOpen ? "IP STATUS" : "IP INITIAL");
+            return Result::Done;
+        }
+
+        if (Is(cmd, len, "+CIICR"))
+        {
+            netOpen = true;
+            return Result::OK;
+        }
+
+        if (Is(cmd, len, "+CIFSR"))
+        {
+            CMD("10.0.0.2");
+            return Result::Done;
+        }
+
+        if (Is(cmd, len, "+CIPSHUT"))
+        {
+            for (auto& c: channels)
+            {
+                c.open = c.connecting = false;
+                c.length = 0;
+            }
+            netOpen = false;
+            CMD("SHUT OK");
+            return Result::Done;
+        }
+
+        if (Starts(cmd, len, "+CIPSSL=", n))
+        {
+            if (!EmulatorArgs(cmd + n, cmd + len).Int(value))
+            {
+                return Result::Error;
+            }
+            ssl = value;
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CIPSTART=", n))
+        {
+            EmulatorArgs args(cmd + n, cmd + len);
+            Span type, host;
+            int port;
+            Channel* c;
+            if (!netOpen || !args.Int(ch) || !args.Str(type) || !args.Str(host) || !args.Int(port) ||
+                !(c = Find(ch, ssl)) || c->open || c->connecting)
+            {
+                return Result::Error;
+            }
+            c->secure = ssl;
+            c->connecting = true;
+            c->sent = 0;
+            Schedule(EventType::Connect, Index(*c), MonoFromMilliseconds(profile.connectMs), OnConnect(ch, ssl, host, port));
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CIPACK=", n))
+        {
+            Channel* c;
+            if (!EmulatorArgs(cmd + n, cmd + len).Int(ch) || !(c = Find(ch, false)) || !c->open)
+            {
+                return Result::Error;
+            }
+            CMD("+CIPACK: %u,%u,0", c->sent, c->sent);
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CIPCLOSE=", n))
+        {
+            Channel* c;
+            if (!EmulatorArgs(cmd + n, cmd + len).Int(ch) || !(c = Find(ch, false)) || !c->open)
+            {
+                return Result::Error;
+            }
+            c->open = false;
+            c->length = 0;
+            CMD("%d, CLOSE OK", ch);
+            return Result::Done;
+        }
+
+        if (Starts(cmd, len, "+CIPSEND=", n))
+        {
+            EmulatorArgs args(cmd + n, cmd + len);
+            Channel* c;
+            if (!args.Int(ch) || !args.Int(value) || !(c = Find(ch, false)) || !c->open ||
+                !value || value > MaxData)
+            {
+                return Result::Error;
+            }
+            prompt.index = Index(*c);
+            prompt.message = false;
+            prompt.length = value;
+            return Result::Prompt;
+        }
+    }
+    else
+    {
+        if (Is(cmd, len, "+NETOPEN") || Is(cmd, len, "+NETCLOSE") || Is(cmd, len, "+CCHSTART") || Is(cmd, len, "+CCHSTOP"))
+        {
+            bool open = Is(cmd, len, "+NETOPEN") || Is(cmd, len, "+CCHSTART");
+            (cmd[1] == 'N' ? netOpen : cchStarted) = open;
+            if (!open)
+            {
+                for (unsigned i = cmd[1] == 'N' ? 0 : Channels; i < (cmd[1] == 'N' ? Channels : Channels + SecureChannels); i++)
+                {
+                    channels[i].open = channels[i].connecting = false;
+                    channels[i].length = 0;
+                }
+            }
+            CMD("OK");
+            CMD("%b: 0", Span(cmd, len));
+            return Result::Done;
+        }
+
+        if (Is(cmd, len, "+NETOPEN?"))
+        {
+            CMD("+NETOPEN: %d", netOpen);
+            return Result::OK;
+        }
+
+        if (Is(cmd, len, "+IPADDR"))
+        {
+            if (!netOpen)
+            {
+                return Result::Error;
+            }
+            CMD("+IPADDR: 10.0.0.2");
+            return Result::OK;
+        }
+
+        if (Is(cmd, len, "+CIPCLOSE?"))
+        {
+            char* p = cmdOut + cmdLen;
+            CMD("+CIPCLOSE: 0,0,0,0,0,0,0,0,0,0");
+            for (unsigned i = 0; i < Channels; i++)
+            {
+                p[2 + 11 + i * 2] = '0' + channels[i].open;
+            }
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CIPOPEN=", n) || Starts(cmd, len, "+CCHOPEN=", n))
+        {
+            EmulatorArgs args(cmd + n, cmd + len);
+            bool secure = cmd[2] == 'C';
+            Span type, host;
+            int port;
+            Channel* c;
+            if (!(secure ? cchStarted : netOpen) || !args.Int(ch) || (!secure && !args.Str(type)) ||
+                !args.Str(host) || !args.Int(port) || !(c = Find(ch, secure)) || c->open || c->connecting)
+            {
+                return Result::Error;
+            }
+            c->secure = secure;
+            c->connecting = true;
+            c->sent = 0;
+            Schedule(EventType::Connect, Index(*c), MonoFromMilliseconds(profile.connectMs), OnConnect(ch, secure, host, port));
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CIPCLOSE=", n) || Starts(cmd, len, "+CCHCLOSE=", n))
+        {
+            bool secure = cmd[2] == 'C';
+            Channel* c;
+            if (!EmulatorArgs(cmd + n, cmd + len).Int(ch) || !(c = Find(ch, secure)) || !c->open)
+            {
+                return Result::Error;
+            }
+            c->open = false;
+            c->length = 0;
+            CMD("OK");
+            CMD("%s: %d,0", secure ? "+CCHCLOSE" : "+CIPCLOSE", ch);
+            return Result::Done;
+        }
+
+        if (Starts(cmd, len, "+CIPSEND=", n) || Starts(cmd, len, "+CCHSEND=", n))
+        {
+            EmulatorArgs args(cmd + n, cmd + len);
+            Channel* c;
+            if (!args.Int(ch) || !args.Int(value) || !(c = Find(ch, cmd[2] == 'C')) || !c->open ||
+                !value || value > MaxData)
+            {
+                return Result::Error;
+            }
+            prompt.index = Index(*c);
+            prompt.message = false;
+            prompt.length = value;
+            return Result::Prompt;
+        }
+
+        if (Is(cmd, len, "+CCHRECV?"))
+        {
+            // data is always delivered automatically, nothing remains buffered
+            CMD("+CCHRECV: LEN,0,0");
+            return Result::OK;
+        }
+
+        if (Starts(cmd, len, "+CCHRECV=", n))
+        {
+            return Result::OK;
+        }
+    }
+
+    if (Starts(cmd, len, "+CMGS=", n))
+    {
+        if (!registered || !EmulatorArgs(cmd + n, cmd + len).Str(s) || s.Length() >= sizeof(recipient))
+        {
+            return Result::Error;
+        }
+        memcpy(recipient, s.Pointer(), s.Length());
+        recipientLength = s.Length();
+        prompt.message = true;
+        return Result::Prompt;
+    }
+
+    // configuration accepted without any effect
+    static const char* const accepted[] = {
+        "+CMEE=", "+CSDT=", "+CLTS=", "+EXUNSOL=", "+CR=", "+CTZR=", "+AUTOCSQ=", "+CPSI=",
+        "+CSCLK=", "+CGDCONT=", "+CGAUTH=", "+CCHSET=", "+CIPMUX=", "+CIPQSEND=", "+CSTT=",
+        "+IFC=", "+ICF=", "+IPR=", "+CPIN=", "+CLCK=", "+CMGF=", "+CGACT=", "+CPOWD=", "+CPOF",
+    };
+
+    for (auto prefix: accepted)
+    {
+        if (Starts(cmd, len, prefix, n))
+        {
+            return Result::OK;
+        }
+    }
+
+    MYDBG("Unsupported command %b", Span(cmd, len));
+    return Result::Error;
+}
+
+void SimComEmulator::Complete(Result res)
+{
+    switch (res)
+    {
+        case Result::OK: CMD("OK"); break;
+        case Result::Error: CMD("ERROR"); stats.errors++; break;
+        case Result::Prompt:
+            if (cmdLen + 2 <= sizeof(cmdOut))
+            {
+                cmdOut[cmdLen++] = '>';
+                cmdOut[cmdLen++] = ' ';
+            }
+            break;
+        default: break;
+    }
+}
+
+void SimComEmulator::Accepted(size_t len)
+{
+    Channel& c = channels[prompt.index];
+    unsigned ch = Number(c);
+    bool failed = Inject(profile.lossPermille);
+
+    stats.packets++;
+    if (failed)
+    {
+        stats.lost++;
+    }
+    else
+    {
+        c.sent += len;
+        stats.sent += len;
+    }
+
+    if (model == Model::SIM800)
+    {
+        if (failed)
+        {
+            CMD("%d, SEND FAIL", ch);
+        }
+        else
+        {
+            CMD("DATA ACCEPT:%d,%d", ch, len);
+        }
+    }
+    else
+    {
+        CMD("OK");
+        if (c.secure)
+        {
+            CMD("+CCHSEND: %d,%d", ch, failed ? 4 : 0);
+        }
+        else if (failed)
+        {
+            CMD("+CIPERROR: 4");
+        }
+        else
+        {
+            CMD("+CIPSEND: %d,%d,%d", ch, len, len);
+        }
+    }
+
+    if (!failed)
+    {
+        OnData(ch, c.secure, Span(sendData, len));
+    }
+}
+
+async(SimComEmulator::Emit, Span text, Span data)
+async_def(
+    Span text, data;
+)
+{
+    f.text = text;
+    f.data = data;
+    // responses and events are produced by separate tasks, they must not interleave
+    await_mask(outputBusy, 1, 0);
+    outputBusy = 1;
+    if (f.text.Length())
+    {
+        await(output.Write, f.text);
+    }
+    if (f.data.Length())
+    {
+        await(output.Write, f.data);
+    }
+    outputBusy = 0;
+}
+async_end
+
+async(SimComEmulator::CommandTask)
+async_def(
+    char line[MaxLine];
+    size_t len;
+    Result res;
+)
+{
+    while (await(input.Require))
+    {
+        if (input.Peek(0) == '\n' || input.Peek(0) == ' ')
+        {
+            input.Advance(1);
+            continue;
+        }
+
+        f.len = await(input.RequireUntil, '\r');
+        if (!f.len)
+        {
+            break;
+        }
+
+        {
+            size_t n = 0;
+            for (char c: input.Enumerate(std::min(f.len - 1, sizeof(f.line))))
+            {
+                f.line[n++] = c;
+            }
+            input.Advance(f.len);
+            f.len = n;
+        }
+
+        stats.commands++;
+        if (echo)
+        {
+            await(Emit, Span(f.line, f.len), "\r");
+        }
+
+        if (profile.latencyMs)
+        {
+            async_delay_ms(profile.latencyMs);
+        }
+
+        cmdLen = 0;
+        if (f.len < 2 || f.line[0] != 'A' || f.line[1] != 'T' || Inject(profile.errorPermille))
+        {
+            f.res = Result::Error;
+        }
+        else
+        {
+            // several commands can be combined in one line, separated by semicolons outside quotes
+            f.res = Result::OK;
+            for (size_t pos = 2, end; f.res == Result::OK && pos <= f.len; pos = end + 1)
+            {
+                bool quoted = false;
+                for (end = pos; end < f.len && (quoted || f.line[end] != ';'); end++)
+                {
+                    if (f.line[end] == '"')
+                    {
+                        quoted = !quoted;
+                    }
+                }
+                f.res = Execute(f.line + pos, end - pos);
+            }
+        }
+
+        Complete(f.res);
+        await(Emit, Span(cmdOut, cmdLen), Span());
+
+        if (f.res != Result::Prompt)
+        {
+            continue;
+        }
+
+        cmdLen = 0;
+        if (prompt.message)
+        {
+            // text terminated by CTRL+Z
+            f.len = await(input.RequireUntil, 26);
+            if (!f.len)
+            {
+                break;
+            }
+
+            {
+                size_t n = 0;
+                for (char c: input.Enumerate(std::min(f.len - 1, sizeof(f.line))))
+                {
+                    f.line[n++] = c;
+                }
+                input.Advance(f.len);
+                f.len = n;
+            }
+
+            OnMessage(Span(recipient, recipientLength), Span(f.line, f.len));
+            CMD("+CMGS: %d", ++messageReference);
+            CMD("OK");
+        }
+        else
+        {
+            f.len = prompt.length;
+            if (!await(input.Require, f.len))
+            {
+                break;
+            }
+
+            {
+                size_t n = 0;
+                for (char c: input.Enumerate(f.len))
+                {
+                    sendData[n++] = c;
+                }
+                input.Advance(f.len);
+            }
+
+            if (Transfer(f.len))
+            {
+                async_delay_ms(Transfer(f.len));
+            }
+
+            Accepted(f.len);
+        }
+
+        await(Emit, Span(cmdOut, cmdLen), Span());
+    }
+
+    MYDBG("Input closed");
+    running = false;
+    wake++;
+    active &= ~CommandActive;
+}
+async_end
+
+async(SimComEmulator::EventTask)
+async_def(
+    uint32_t seen;
+    unsigned i;
+    Event e;
+    size_t len;
+)
+{
+    while (running)
+    {
+        f.seen = wake;
+        f.i = MaxEvents;
+        for (unsigned i = 0; i < MaxEvents; i++)
+        {
+            if (events[i].type != EventType::None && (f.i == MaxEvents || OVF_DIFF(events[i].due, events[f.i].due) < 0))
+            {
+                f.i = i;
+            }
+        }
+
+        if (f.i == MaxEvents)
+        {
+            await_mask_not(wake, ~0u, f.seen);
+            continue;
+        }
+
+        if (OVF_DIFF(events[f.i].due, MONO_CLOCKS) > 0)
+        {
+            await_mask_not_timeout(wake, ~0u, f.seen, Timeout::Absolute(events[f.i].due));
+            continue;
+        }
+
+        f.e = events[f.i];
+        events[f.i].type = EventType::None;
+        evtLen = 0;
+        f.len = 0;
+
+        switch (f.e.type)
+        {
+            case EventType::PowerOn:
+                EVT("RDY");
+                EVT("+CFUN: 1");
+                EVT("+CPIN: READY");
+                if (model == Model::SIM800)
+                {
+                    EVT("Call Ready");
+                    EVT("SMS Ready");
+                }
+                else
+                {
+                    EVT("SMS DONE");
+                    EVT("PB DONE");
+                }
+                break;
+
+            case EventType::Registration:
+                registered = f.e.success;
+                attached = attached || registered;
+                if (creg)
+                {
+                    EVT("+CREG: %d,\"00A1\",\"0B2C\"", registered ? 1 : 2);
+                }
+                if (cgreg)
+                {
+                    EVT("+CGREG: %d,\"00A1\",\"0B2C\"", registered && attached ? 1 : 2);
+                }
+                break;
+
+            case EventType::Connect:
+            {
+                Channel& c = channels[f.e.index];
+                if (!c.connecting)
+                {
+                    break;
+                }
+                c.connecting = false;
+                c.open = f.e.success;
+                c.length = 0;
+                if (model == Model::SIM800)
+                {
+                    EVT("%d, %s", Number(c), c.open ? "CONNECT OK" : "CONNECT FAIL");
+                }
+                else
+                {
+                    EVT("%s: %d,%d", c.secure ? "+CCHOPEN" : "+CIPOPEN", Number(c), c.open ? 0 : 4);
+                }
+                break;
+            }
+
+            case EventType::Data:
+            {
+                Channel& c = channels[f.e.index];
+                if (!c.open || !c.length)
+                {
+                    break;
+                }
+                f.len = c.length;
+                if (model == Model::SIM800)
+                {
+                    EVT("+RECEIVE,%d,%d:", Number(c), f.len);
+                }
+                else if (c.secure)
+                {
+                    EVT("+CCHRECV: DATA,%d,%d", Number(c), f.len);
+                }
+                else
+                {
+                    EVT("+RECEIVE,%d,%d", Number(c), f.len);
+                }
+                // data follows right after the line
+                break;
+            }
+
+            case EventType::PeerClose:
+            {
+                Channel& c = channels[f.e.index];
+                if (!c.open)
+                {
+                    break;
+                }
+                c.open = false;
+                c.length = 0;
+                if (model == Model::SIM800)
+                {
+                    EVT("%d, CLOSED", Number(c));
+                }
+                else if (c.secure)
+                {
+                    EVT("+CCH_PEER_CLOSED: %d", Number(c));
+                }
+                else
+                {
+                    EVT("+IPCLOSE: %d,1", Number(c));
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        await(Emit, Span(evtOut, evtLen), Span(channels[f.e.index].data, f.len));
+
+        if (!f.len)
+        {
+            continue;
+        }
+
+        {
+            // more data may have been queued while sending, or the channel
+            // closed by a command processed in the meantime
+            Channel& c = channels[f.e.index];
+            stats.received += f.len;
+            if (!c.open || c.length < f.len)
+            {
+                c.length = 0;
+                continue;
+            }
+            c.length -= f.len;
+            memmove(c.data, c.data + f.len, c.length);
+            if (c.length)
+            {
+                Schedule(EventType::Data, f.e.index, MonoFromMilliseconds(Transfer(c.length)));
+            }
+
+            evtLen = 0;
+            if (model == Model::SIM7600 && c.secure)
+            {
+                EVT("+CCHRECV: %d,0", Number(c));
+            }
+        }
+
+        if (evtLen)
+        {
+            await(Emit, Span(evtOut, evtLen), Span());
+        }
+    }
+
+    output.Close();
+    active &= ~EventActive;
+}
+async_end
+
+}
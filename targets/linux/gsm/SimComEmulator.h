@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2021 triaxis s.r.o.
+ * Licensed under the MIT license. See LICENSE.txt file in the repository root
+ * for full license information.
+ *
+ * gsm/SimComEmulator.h
+ *
+ * Software model of the SIM800 and SIM7600 AT dialects, for running
+ * the driver without hardware
+ */
+
+#pragma once
+
+#include <kernel/kernel.h>
+#include <io/io.h>
+
+namespace gsm
+{
+
+//! Emulates the subset of the SimCom AT commands used by SimComModem
+//! The remote side of the sockets echoes the data back by default,
+//! override OnConnect, OnData and OnMessage to script it
+class SimComEmulator
+{
+public:
+    enum struct Model
+    {
+        SIM800,
+        SIM7600,
+    };
+
+    //! Link and network characteristics
+    struct Profile
+    {
+        unsigned latencyMs = 0;         //!< delay before each command is answered
+        unsigned connectMs = 100;       //!< delay of socket connection results
+        unsigned registrationMs = 500;  //!< delay of network registration after start
+        unsigned bandwidth = 0;         //!< bytes per second of the socket data, zero if unlimited
+        uint16_t lossPermille = 0;      //!< portion of socket sends failing and incoming packets lost
+        uint16_t errorPermille = 0;     //!< portion of commands answered with ERROR
+        uint32_t seed = 1;              //!< seed of the pseudo-random injection, runs are repeatable
+    };
+
+    enum
+    {
+        //! Channels of each kind, TLS channels are separate on SIM7600
+        Channels = 10,
+        SecureChannels = 2,
+        //! Maximum incoming data buffered for one channel
+        MaxData = 1500,
+        MaxLine = 256,
+        //! Events waiting for delivery
+        MaxEvents = 16,
+    };
+
+    //! @param modem the link as seen from the modem, i.e. the driver pipes swapped
+    SimComEmulator(Model model, io::DuplexPipe modem)
+        : model(model), input(modem), output(modem) {}
+
+    void Configure(const Profile& profile) { this->profile = profile; rnd = profile.seed | 1; }
+    const Profile& Configuration() const { return profile; }
+
+    //! Starts processing commands, the power-on events are sent first
+    //! The settings and connections of a previous run are discarded, as after a power cycle
+    void Start();
+    //! Waits until the driver closes its output and the emulator closes its own
+    async(WaitForStop, Timeout timeout = Timeout::Infinite);
+    bool IsRunning() const { return !!active; }
+
+    //! Queues incoming data for the channel, delivered after the configured latency
+    //! @returns the number of bytes accepted
+    size_t Deliver(unsigned ch, bool secure, Span data);
+    //! Closes the connection from the remote side
+    void PeerClose(unsigned ch, bool secure);
+    //! Changes the network registration, reported by +CREG/+CGREG events
+    void Register(bool registered);
+
+    //! Counters for benchmarks
+    struct Stats
+    {
+        uint32_t commands, errors;
+        uint32_t sent, received;    //!< socket data bytes, from the point of view of the driver
+        uint32_t packets;           //!< socket sends
+        uint32_t lost;              //!< sends failed and packets dropped by loss injection
+    };
+
+    const Stats& Statistics() const { return stats; }
+
+protected:
+    //! Called when the driver connects a socket, return false to refuse the connection
+    virtual bool OnConnect(unsigned ch, bool secure, Span host, unsigned port) { return true; }
+    //! Called with data sent by the driver, echoes it back by default
+    virtual void OnData(unsigned ch, bool secure, Span data) { Deliver(ch, secure, data); }
+    //! Called with a text message sent by the driver
+    virtual void OnMessage(Span recipient, Span text) { }
+
+private:
+    struct Channel
+    {
+        bool open, connecting, secure;
+        uint32_t sent;      //!< bytes sent since the connection was opened
+        size_t length;
+        char data[MaxData];
+    };
+
+    enum struct EventType : uint8_t
+    {
+        None,
+        PowerOn,
+        Registration,
+        Connect,
+        Data,
+        PeerClose,
+    };
+
+    struct Event
+    {
+        mono_t due;
+        EventType type;
+        uint8_t index;
+        bool success;
+    };
+
+    enum struct Result
+    {
+        OK,
+        Error,
+        Done,       //!< the response replaces OK
+        Prompt,     //!< data follows after the > prompt
+    };
+
+    Model model;
+    io::PipeReader input;
+    io::PipeWriter output;
+    Profile profile;
+    Stats stats = {};
+    uint32_t rnd = 1;
+
+    enum
+    {
+        // active tasks
+        CommandActive = BIT(0),
+        EventActive = BIT(1),
+    };
+
+    bool running = false;
+    uint8_t active = 0;
+    bool echo = true, registered = false, attached = false, ssl = false;
+    bool netOpen = false, cchStarted = false;
+    uint8_t creg = 0, cgreg = 0;
+    uint8_t outputBusy = 0;
+    uint32_t wake = 0;
+    uint8_t messageReference = 0;
+
+    Channel channels[Channels + SecureChannels] = {};
+    Event events[MaxEvents] = {};
+
+    // staging of responses, separate for each task
+    char cmdOut[MaxLine * 2], evtOut[MaxLine];
+    size_t cmdLen, evtLen;
+
+    //! Parameters of the command waiting for data after the prompt
+    struct
+    {
+        uint8_t index;
+        bool message;
+        size_t length;
+    } prompt;
+    char recipient[24];
+    size_t recipientLength;
+    char sendData[MaxData];
+
+    Channel* Find(unsigned ch, bool secure);
+    unsigned Index(Channel& c) const { return &c - channels; }
+    unsigned Number(Channel& c) const { return Index(c) >= Channels ? Index(c) - Channels : Index(c); }
+    bool Inject(uint16_t permille);
+    //! Time in ms to transfer the data with the configured bandwidth
+    unsigned Transfer(size_t len) const;
+    void Schedule(EventType type, unsigned index, mono_t delay, bool success = true);
+
+    void Line(char* buf, size_t& len, size_t size, const char* format, ...);
+    Result Execute(const char* cmd, size_t len);
+    void Complete(Result res);
+    void Accepted(size_t len);
+
+    async(Emit, Span text, Span data);
+    async(CommandTask);
+    async(EventTask);
+};
+
+}